@@ -0,0 +1,111 @@
+#include "./binaryfuse-filter.h"
+#include <algorithm>
+
+void BinaryFuseFilter::resize(size_t n) {
+   // Segment length and over-allocation factor from the reference implementation
+   if (n > 0xffffffffu) throw "too big";
+   double size = double(std::max(n, size_t(2)));
+   this->segmentLength = n ? uint32_t(1) << int(floor(log(size) / log(3.33) + 2.25)) : 4;
+   if (this->segmentLength > 262144) this->segmentLength = 262144;
+   this->segmentLengthMask = this->segmentLength - 1;
+   double sizeFactor = n <= 1 ? 0.0 : std::max(1.125, 0.875 + 0.25 * log(1000000.0) / log(size));
+   int64_t capacity = int64_t(round(double(n) * sizeFactor));
+   int64_t segmentCount = (capacity + this->segmentLength - 1) / this->segmentLength - (Arity - 1);
+   if (segmentCount < 1) segmentCount = 1;
+   this->segmentCount = uint32_t(segmentCount);
+   this->segmentCountLength = this->segmentCount * this->segmentLength;
+   this->fingerprints.assign(size_t(this->segmentCount + Arity - 1) * this->segmentLength, 0);
+}
+
+// Peel the 3-hypergraph of the keys: repeatedly remove a position used by
+// one key only, then assign fingerprints in reverse peeling order
+bool BinaryFuseFilter::populate(const std::vector<uint64_t>& hashes) {
+   size_t n = hashes.size();
+   size_t capacity = this->fingerprints.size();
+   std::vector<uint8_t> t2count(capacity, 0); // keys count << 2 | xor of key slots (0, 1, 2)
+   std::vector<uint64_t> t2hash(capacity, 0); // xor of keys hashes
+   std::vector<uint32_t> alone(capacity);
+   std::vector<uint64_t> stack(n);
+   std::vector<uint8_t> stackSlot(n);
+   uint32_t positions[Arity + 2];
+
+   for (uint64_t hash : hashes) {
+      this->positions_of(hash, positions);
+      for (uint32_t slot = 0; slot < Arity; slot++) {
+         uint8_t& count = t2count[positions[slot]];
+         count += 4;
+         count ^= uint8_t(slot);
+         t2hash[positions[slot]] ^= hash;
+         if (count < 4) return false; // counter overflow
+      }
+   }
+
+   size_t aloneCount = 0;
+   for (uint32_t i = 0; i < capacity; i++) {
+      alone[aloneCount] = i;
+      aloneCount += ((t2count[i] >> 2) == 1) ? 1 : 0;
+   }
+   size_t stackSize = 0;
+   while (aloneCount > 0) {
+      uint32_t index = alone[--aloneCount];
+      if ((t2count[index] >> 2) != 1) continue;
+      uint64_t hash = t2hash[index];
+      uint8_t found = t2count[index] & 3;
+      stackSlot[stackSize] = found;
+      stack[stackSize] = hash;
+      stackSize++;
+
+      this->positions_of(hash, positions);
+      positions[3] = positions[0];
+      positions[4] = positions[1];
+      for (uint32_t i = 1; i < Arity; i++) {
+         uint32_t other = positions[found + i];
+         alone[aloneCount] = other;
+         aloneCount += ((t2count[other] >> 2) == 2) ? 1 : 0;
+         t2count[other] -= 4;
+         t2count[other] ^= uint8_t((found + i) % Arity);
+         t2hash[other] ^= hash;
+      }
+   }
+   if (stackSize != n) return false;
+
+   for (size_t i = n; i > 0; i--) {
+      uint64_t hash = stack[i - 1];
+      uint8_t found = stackSlot[i - 1];
+      this->positions_of(hash, positions);
+      positions[3] = positions[0];
+      positions[4] = positions[1];
+      this->fingerprints[positions[found]] = fingerprint_of(hash)
+         ^ this->fingerprints[positions[found + 1]]
+         ^ this->fingerprints[positions[found + 2]];
+   }
+   return true;
+}
+
+void BinaryFuseFilter::build(const uint64_t* keys, size_t n) {
+   std::vector<uint64_t> uniqueKeys;
+   std::vector<uint64_t> hashes(n);
+   this->resize(n);
+   for (int attempt = 0; attempt < MaxAttempts; attempt++) {
+      this->seed = hash64(uint64_t(attempt) + 1);
+      for (size_t i = 0; i < n; i++) {
+         hashes[i] = hash64(&keys[i], sizeof(uint64_t), this->seed);
+      }
+      if (this->populate(hashes)) return;
+      std::fill(this->fingerprints.begin(), this->fingerprints.end(), uint8_t(0));
+
+      // Duplicated keys never peel, remove them once before retrying
+      if (attempt == 0) {
+         uniqueKeys.assign(keys, keys + n);
+         std::sort(uniqueKeys.begin(), uniqueKeys.end());
+         uniqueKeys.erase(std::unique(uniqueKeys.begin(), uniqueKeys.end()), uniqueKeys.end());
+         if (uniqueKeys.size() != n) {
+            keys = uniqueKeys.data();
+            n = uniqueKeys.size();
+            hashes.resize(n);
+            this->resize(n);
+         }
+      }
+   }
+   throw "cannot build binary fuse filter";
+}
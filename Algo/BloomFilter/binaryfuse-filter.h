@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include "./bloomfilter.h"
+
+// Static binary fuse filter (Graf & Lemire), with 8 bits fingerprints:
+// a key is present when the xor of 3 fingerprints, taken in 3 consecutive
+// segments of the array, equals its own fingerprint.
+// Built once from a set of keys: about 9 bits per key for a 0.39% false
+// positive rate, no insertion nor removal after build.
+class BinaryFuseFilter {
+public:
+   static const uint32_t Arity = 3;
+   static const int MaxAttempts = 100;
+   uint64_t seed; // Seed of the key hashing, chosen by build()
+private:
+   std::vector<uint8_t> fingerprints;
+   uint32_t segmentLength;
+   uint32_t segmentLengthMask;
+   uint32_t segmentCount;
+   uint32_t segmentCountLength;
+
+   static uint8_t fingerprint_of(uint64_t hash) {
+      return uint8_t(hash ^ (hash >> 32));
+   }
+   void positions_of(uint64_t hash, uint32_t positions[Arity]) {
+      uint32_t h0 = uint32_t(mulhi64(hash, this->segmentCountLength));
+      uint32_t h1 = h0 + this->segmentLength;
+      uint32_t h2 = h1 + this->segmentLength;
+      positions[0] = h0;
+      positions[1] = h1 ^ (uint32_t(hash >> 18) & this->segmentLengthMask);
+      positions[2] = h2 ^ (uint32_t(hash) & this->segmentLengthMask);
+   }
+   void resize(size_t n);
+   bool populate(const std::vector<uint64_t>& hashes);
+public:
+   BinaryFuseFilter() : seed(0) {
+      this->resize(0);
+   }
+   size_t memory() const {
+      return this->fingerprints.size();
+   }
+   void clear() {
+      this->resize(0);
+   }
+   // Replace the filter content by the set of n keys,
+   // duplicated keys are accepted
+   void build(const uint64_t* keys, size_t n);
+
+   bool has(uint64_t hash) {
+      uint32_t positions[Arity];
+      this->positions_of(hash, positions);
+      uint8_t f = fingerprint_of(hash);
+      f ^= this->fingerprints[positions[0]] ^ this->fingerprints[positions[1]] ^ this->fingerprints[positions[2]];
+      return f == 0;
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+};
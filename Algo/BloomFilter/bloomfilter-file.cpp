@@ -0,0 +1,132 @@
+#include "./bloomfilter-file.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char c_Magic[8] = { 'B', 'L', 'O', 'O', 'M', 'F', 'L', 'T' };
+
+BloomFilterHeader::BloomFilterHeader(Layout layout, uint64_t m, uint64_t k, uint64_t seed, uint64_t dataSize) {
+   memset(this, 0, sizeof(*this));
+   memcpy(this->magic, c_Magic, sizeof(c_Magic));
+   this->version = c_Version;
+   this->layout = layout;
+   this->m = m;
+   this->k = k;
+   this->seed = seed;
+   this->dataOffset = c_PageSize;
+   this->dataSize = dataSize;
+}
+
+bool BloomFilterHeader::isValid() const {
+   if (memcmp(this->magic, c_Magic, sizeof(c_Magic))) return false;
+   if (this->version != c_Version) return false;
+   if (this->layout != Flat && this->layout != Blocked) return false;
+   if (this->m == 0 || this->k == 0) return false;
+   return (this->dataOffset % c_PageSize) == 0;
+}
+
+static void SaveFilter(const char* path, const BloomFilterHeader& header, const void* data) {
+   FILE* file = fopen(path, "wb");
+   if (!file) throw "cannot create filter file";
+   static const char padding[BloomFilterHeader::c_PageSize] = { 0 };
+   bool done = fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(padding, size_t(header.dataOffset - sizeof(header)), 1, file) == 1
+      && fwrite(data, size_t(header.dataSize), 1, file) == 1;
+   done = (fclose(file) == 0) && done;
+   if (!done) throw "cannot write filter file";
+}
+
+void BloomFilterFile::Save(const char* path, const BloomFilter& filter) {
+   BloomFilterHeader header(BloomFilterHeader::Flat, filter.m, filter.k, filter.seed, filter.memory());
+   SaveFilter(path, header, filter.data());
+}
+
+void BloomFilterFile::Save(const char* path, const BlockedBloomFilter& filter) {
+   BloomFilterHeader header(BloomFilterHeader::Blocked, filter.m, filter.k, filter.seed, filter.memory());
+   SaveFilter(path, header, filter.data());
+}
+
+/*******************************************************
+**** FOR _WIN32
+*******************************************************/
+#if defined(_WIN32)
+BloomFilterFile::BloomFilterFile(const char* path) {
+   this->header = 0;
+   this->hFileMap = 0;
+   this->hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (this->hFile == INVALID_HANDLE_VALUE) throw "cannot open filter file";
+   LARGE_INTEGER fileSize;
+   GetFileSizeEx(this->hFile, &fileSize);
+   this->size = fileSize.QuadPart;
+   if (this->size >= sizeof(BloomFilterHeader)) {
+      this->hFileMap = CreateFileMappingA(this->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (this->hFileMap) this->header = (BloomFilterHeader*)MapViewOfFile(this->hFileMap, FILE_MAP_READ, 0, 0, 0);
+   }
+   if (!this->header || !this->header->isValid() || this->size < this->header->dataOffset + this->header->dataSize) {
+      this->Close();
+      throw "invalid filter file";
+   }
+}
+
+void BloomFilterFile::Close() {
+   if (this->header) UnmapViewOfFile(this->header);
+   if (this->hFileMap) CloseHandle(this->hFileMap);
+   if (this->hFile != INVALID_HANDLE_VALUE) CloseHandle(this->hFile);
+   this->header = 0;
+   this->hFileMap = 0;
+   this->hFile = INVALID_HANDLE_VALUE;
+}
+
+/*******************************************************
+**** FOR posix
+*******************************************************/
+#else
+BloomFilterFile::BloomFilterFile(const char* path) {
+   this->header = 0;
+   this->fd = open(path, O_RDONLY);
+   if (this->fd < 0) throw "cannot open filter file";
+   struct stat infos;
+   this->size = fstat(this->fd, &infos) ? 0 : uint64_t(infos.st_size);
+   if (this->size >= sizeof(BloomFilterHeader)) {
+      void* view = mmap(0, size_t(this->size), PROT_READ, MAP_SHARED, this->fd, 0);
+      if (view != MAP_FAILED) this->header = (BloomFilterHeader*)view;
+   }
+   if (!this->header || !this->header->isValid() || this->size < this->header->dataOffset + this->header->dataSize) {
+      this->Close();
+      throw "invalid filter file";
+   }
+}
+
+void BloomFilterFile::Close() {
+   if (this->header) munmap(this->header, size_t(this->size));
+   if (this->fd >= 0) close(this->fd);
+   this->header = 0;
+   this->fd = -1;
+}
+#endif
+
+BloomFilterFile::~BloomFilterFile() {
+   this->Close();
+}
+
+std::unique_ptr<BloomFilter> BloomFilterFile::OpenFlat() {
+   if (this->header->layout != BloomFilterHeader::Flat) throw "not a flat filter file";
+   void* storage = (uint8_t*)this->header + this->header->dataOffset;
+   std::unique_ptr<BloomFilter> filter(new BloomFilter(size_t(header->m), size_t(header->k), header->seed, storage));
+   if (filter->memory() != this->header->dataSize) throw "invalid filter file";
+   return filter;
+}
+
+std::unique_ptr<BlockedBloomFilter> BloomFilterFile::OpenBlocked() {
+   if (this->header->layout != BloomFilterHeader::Blocked) throw "not a blocked filter file";
+   void* storage = (uint8_t*)this->header + this->header->dataOffset;
+   std::unique_ptr<BlockedBloomFilter> filter(new BlockedBloomFilter(size_t(header->m), size_t(header->k), header->seed, storage));
+   if (filter->memory() != this->header->dataSize) throw "invalid filter file";
+   return filter;
+}
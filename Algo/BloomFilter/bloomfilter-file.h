@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include "./bloomfilter.h"
+
+// On-disk format of a bloom filter:
+// - one page holding the BloomFilterHeader
+// - the filter storage, starting on a page boundary
+// The storage is the in-memory layout of the filter, so a mapped file
+// is directly usable for lookups.
+struct BloomFilterHeader {
+   static const uint32_t c_Version = 1;
+   static const uint64_t c_PageSize = 4096;
+
+   enum Layout : uint32_t {
+      Flat = 1, // BloomFilter
+      Blocked = 2, // BlockedBloomFilter
+   };
+
+   char magic[8]; // "BLOOMFLT"
+   uint32_t version;
+   Layout layout;
+   uint64_t m; // Number of bits
+   uint64_t k; // Number of hash functions
+   uint64_t seed; // Seed of the key hashing
+   uint64_t dataOffset; // Offset of the storage, page aligned
+   uint64_t dataSize; // Size of the storage in bytes
+
+   BloomFilterHeader(Layout layout, uint64_t m, uint64_t k, uint64_t seed, uint64_t dataSize);
+   bool isValid() const;
+};
+
+// Read-only mapping of a bloom filter file: the opened filters probe the
+// page cache directly, so loading costs no copy and the pages are shared
+// by all the processes mapping the same file.
+class BloomFilterFile {
+   BloomFilterHeader* header;
+   uint64_t size;
+#if defined(_WIN32)
+   void* hFile;
+   void* hFileMap;
+#else
+   int fd;
+#endif
+   void Close();
+public:
+   static void Save(const char* path, const BloomFilter& filter);
+   static void Save(const char* path, const BlockedBloomFilter& filter);
+
+   BloomFilterFile(const char* path);
+   BloomFilterFile(const BloomFilterFile&) = delete;
+   BloomFilterFile& operator = (const BloomFilterFile&) = delete;
+   ~BloomFilterFile();
+
+   const BloomFilterHeader& infos() const {
+      return *this->header;
+   }
+
+   // Filters viewing the mapped storage: they are read-only (add() faults)
+   // and shall not outlive the file
+   std::unique_ptr<BloomFilter> OpenFlat();
+   std::unique_ptr<BlockedBloomFilter> OpenBlocked();
+};
@@ -0,0 +1,267 @@
+#include "./bloomfilter.h"
+#include "./simd.h"
+#include <algorithm>
+#include <vector>
+
+// Number of keys hashed and prefetched together
+static const size_t BatchSize = 16;
+
+// Flat filters larger than a typical L2 are tested in stages, prefetching
+// the first StagedProbes probes of each key before the others
+static const size_t StagedBytes = 4 << 20;
+static const size_t StagedProbes = 2;
+
+static void set_result(uint64_t* out_bitmap, size_t index, bool found) {
+   out_bitmap[index / 64] |= uint64_t(found) << (index % 64);
+}
+
+static const bool cpu_has_avx2 = CpuHasAVX2();
+
+/*******************************************************
+**** Key hashing, scalar and AVX2 paths
+*******************************************************/
+static inline void hash_keys(const uint64_t* keys, size_t count, uint64_t seed, uint64_t* hashes) {
+   for (size_t i = 0; i < count; i++) {
+      hashes[i] = hash64(&keys[i], sizeof(uint64_t), seed);
+   }
+}
+
+#if BLOOM_X86
+
+// Low 64 bits of a * b on each lane, AVX2 has no 64 bits multiply
+BLOOM_TARGET_AVX2 static inline __m256i mul64_avx2(__m256i a, uint64_t b) {
+   __m256i vb = _mm256_set1_epi64x(int64_t(b));
+   __m256i lo = _mm256_mul_epu32(a, vb);
+   __m256i cross = _mm256_add_epi64(
+      _mm256_mul_epu32(_mm256_srli_epi64(a, 32), vb),
+      _mm256_mul_epu32(a, _mm256_srli_epi64(vb, 32)));
+   return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+BLOOM_TARGET_AVX2 static inline __m256i xorshift_avx2(__m256i v, int shift) {
+   return _mm256_xor_si256(v, _mm256_srli_epi64(v, shift));
+}
+
+// Same computation as hash64(&key, sizeof(uint64_t), seed), 4 keys per vector
+BLOOM_TARGET_AVX2 static inline void hash_keys_avx2(const uint64_t* keys, size_t count, uint64_t seed, uint64_t* hashes) {
+   const uint64_t mul = 0xc6a4a7935bd1e995ull;
+   const __m256i h0 = _mm256_set1_epi64x(int64_t(seed ^ (sizeof(uint64_t) * mul)));
+   size_t i = 0;
+   for (; i + 4 <= count; i += 4) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)&keys[i]);
+      v = mul64_avx2(v, mul);
+      v = mul64_avx2(xorshift_avx2(v, 47), mul);
+      __m256i h = mul64_avx2(_mm256_xor_si256(h0, v), mul);
+      h = mul64_avx2(xorshift_avx2(h, 33), 0xff51afd7ed558ccdull);
+      h = mul64_avx2(xorshift_avx2(h, 33), 0xc4ceb9fe1a85ec53ull);
+      _mm256_storeu_si256((__m256i*)&hashes[i], xorshift_avx2(h, 33));
+   }
+   hash_keys(keys + i, count - i, seed, hashes + i);
+}
+
+#else
+static inline void hash_keys_avx2(const uint64_t* keys, size_t count, uint64_t seed, uint64_t* hashes) {
+   hash_keys(keys, count, seed, hashes);
+}
+#endif
+
+template <bool AVX2>
+static inline void hash_batch(const uint64_t* keys, size_t count, uint64_t seed, uint64_t* hashes) {
+   if (AVX2) hash_keys_avx2(keys, count, seed, hashes);
+   else hash_keys(keys, count, seed, hashes);
+}
+
+// The batch path is selected once per add_many/has_many call, the bit tests
+// inline in the batch loops, only the hashing of a group is a call
+static bool batch_avx2 = cpu_has_avx2;
+
+const char* BloomFilter::use_simd(bool enabled) {
+   batch_avx2 = enabled && cpu_has_avx2;
+   return batch_avx2 ? "avx2" : "scalar";
+}
+
+const char* BlockedBloomFilter::use_simd(bool enabled) {
+   return BloomFilter::use_simd(enabled);
+}
+
+/*******************************************************
+**** BloomFilter batch operations
+*******************************************************/
+// Hash a group of keys and store their k probe positions, prefetch the
+// cache lines of the first prefetched probes of each key
+template <bool AVX2>
+inline void BloomFilter::probe_batch(const uint64_t* keys, size_t count, uint64_t* bits, size_t prefetched) {
+   uint64_t hashes[BatchSize];
+   hash_batch<AVX2>(keys, count, seed, hashes);
+   for (size_t j = 0; j < count; j++, bits += k) {
+      uint64_t hash = hashes[j];
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      for (size_t p = 0; p < k; p++, hash += delta) {
+         bits[p] = fastrange64(hash, m);
+      }
+      for (size_t p = 0; p < prefetched; p++) {
+         BLOOM_PREFETCH(&this->bitmaps[bits[p] / BitmapBits]);
+      }
+   }
+}
+
+// Test probes first to last of a key without branches, bit 0 of the result is set
+// when all are in the filter
+inline uint64_t BloomFilter::has_bits(const uint64_t* bits, size_t first, size_t last) {
+   uint64_t found = 1;
+   for (size_t p = first; p < last; p++) {
+      found &= this->bitmaps[bits[p] / BitmapBits] >> (bits[p] % BitmapBits);
+   }
+   return found;
+}
+
+template <bool AVX2>
+inline void BloomFilter::add_batch(const uint64_t* keys, size_t n) {
+   std::vector<uint64_t> bits(BatchSize * k);
+   for (size_t i = 0; i < n; i += BatchSize) {
+      size_t count = std::min(BatchSize, n - i);
+      this->probe_batch<AVX2>(keys + i, count, bits.data(), k);
+      for (size_t p = 0; p < count * k; p++) {
+         this->add_bit(bits[p]);
+      }
+   }
+}
+
+template <bool AVX2>
+inline void BloomFilter::has_batch(const uint64_t* keys, size_t n, uint64_t* out_bitmap) {
+   // Double buffered: the probe positions of the next group are computed
+   // and prefetched before the current group is tested
+   const size_t stride = BatchSize * k;
+   std::vector<uint64_t> bits(2 * stride);
+   memset(out_bitmap, 0, (n + 63) / 64 * sizeof(uint64_t));
+   if (n) this->probe_batch<AVX2>(keys, std::min(BatchSize, n), bits.data(), k);
+   for (size_t i = 0, group = 0; i < n; i += BatchSize, group ^= 1) {
+      size_t next = i + BatchSize;
+      if (next < n) this->probe_batch<AVX2>(keys + next, std::min(BatchSize, n - next), &bits[(group ^ 1) * stride], k);
+      const uint64_t* bit = &bits[group * stride];
+      size_t count = std::min(BatchSize, n - i);
+      for (size_t j = 0; j < count; j++, bit += k) {
+         out_bitmap[(i + j) / 64] |= (this->has_bits(bit, 0, k) & 1) << ((i + j) % 64);
+      }
+   }
+}
+
+template <bool AVX2>
+inline void BloomFilter::has_staged(const uint64_t* keys, size_t n, uint64_t* out_bitmap) {
+   // Three stages over consecutive groups: the probe positions of a group are
+   // computed and its first probes prefetched, the next iteration tests them
+   // and prefetches the other probes of the keys that passed, the last stage
+   // tests those. A missing key usually costs the lines of its first probes only.
+   const size_t first = std::min(k, StagedProbes);
+   const size_t stride = BatchSize * k;
+   std::vector<uint64_t> bits(3 * stride);
+   uint8_t passed[3][BatchSize];
+   size_t passedCount[3] = { 0, 0, 0 };
+   memset(out_bitmap, 0, (n + 63) / 64 * sizeof(uint64_t));
+
+   size_t groups = (n + BatchSize - 1) / BatchSize;
+   for (size_t g = 0; g < groups + 2; g++) {
+      if (g >= 2) {
+         size_t i = (g - 2) * BatchSize, stage = (g - 2) % 3;
+         const uint64_t* bit = &bits[stage * stride];
+         for (size_t p = 0; p < passedCount[stage]; p++) {
+            size_t j = passed[stage][p];
+            out_bitmap[(i + j) / 64] |= (this->has_bits(bit + j * k, first, k) & 1) << ((i + j) % 64);
+         }
+      }
+      if (g >= 1 && g <= groups) {
+         size_t i = (g - 1) * BatchSize, stage = (g - 1) % 3;
+         size_t count = std::min(BatchSize, n - i);
+         const uint64_t* bit = &bits[stage * stride];
+         size_t& pass = passedCount[stage];
+         pass = 0;
+         for (size_t j = 0; j < count; j++) {
+            passed[stage][pass] = uint8_t(j);
+            pass += this->has_bits(bit + j * k, 0, first) & 1;
+         }
+         for (size_t p = 0; p < pass; p++) {
+            const uint64_t* probes = bit + passed[stage][p] * k;
+            for (size_t q = first; q < k; q++) {
+               BLOOM_PREFETCH(&this->bitmaps[probes[q] / BitmapBits]);
+            }
+         }
+      }
+      if (g < groups) {
+         size_t i = g * BatchSize;
+         this->probe_batch<AVX2>(keys + i, std::min(BatchSize, n - i), &bits[g % 3 * stride], first);
+      }
+   }
+}
+
+void BloomFilter::add_many(const uint64_t* keys, size_t n) {
+   if (batch_avx2) this->add_batch<true>(keys, n);
+   else this->add_batch<false>(keys, n);
+}
+
+void BloomFilter::has_many(const uint64_t* keys, size_t n, uint64_t* out_bitmap) {
+   if (this->memory() > StagedBytes) {
+      if (batch_avx2) this->has_staged<true>(keys, n, out_bitmap);
+      else this->has_staged<false>(keys, n, out_bitmap);
+   }
+   else {
+      if (batch_avx2) this->has_batch<true>(keys, n, out_bitmap);
+      else this->has_batch<false>(keys, n, out_bitmap);
+   }
+}
+
+/*******************************************************
+**** BlockedBloomFilter batch operations
+*******************************************************/
+template <bool AVX2>
+inline void BlockedBloomFilter::add_batch(const uint64_t* keys, size_t n) {
+   uint64_t hashes[BatchSize];
+   for (size_t i = 0; i < n; i += BatchSize) {
+      size_t count = std::min(BatchSize, n - i);
+      hash_batch<AVX2>(keys + i, count, seed, hashes);
+      for (size_t j = 0; j < count; j++) {
+         BLOOM_PREFETCH(&this->block_of(hashes[j]));
+      }
+      for (size_t j = 0; j < count; j++) {
+         this->add(hashes[j]);
+      }
+   }
+}
+
+template <bool AVX2>
+inline void BlockedBloomFilter::has_batch(const uint64_t* keys, size_t n, uint64_t* out_bitmap) {
+   // Double buffered: the next group is hashed and prefetched
+   // before the current group is tested
+   uint64_t hashes[2][BatchSize];
+   memset(out_bitmap, 0, (n + 63) / 64 * sizeof(uint64_t));
+   if (!n) return;
+
+   size_t count = std::min(BatchSize, n);
+   hash_batch<AVX2>(keys, count, seed, hashes[0]);
+   for (size_t j = 0; j < count; j++) {
+      BLOOM_PREFETCH(&this->block_of(hashes[0][j]));
+   }
+   for (size_t i = 0, group = 0; i < n; i += BatchSize, group ^= 1) {
+      size_t next = i + BatchSize;
+      size_t next_count = next < n ? std::min(BatchSize, n - next) : 0;
+      if (next_count) {
+         hash_batch<AVX2>(keys + next, next_count, seed, hashes[group ^ 1]);
+         for (size_t j = 0; j < next_count; j++) {
+            BLOOM_PREFETCH(&this->block_of(hashes[group ^ 1][j]));
+         }
+      }
+      for (size_t j = 0; j < count; j++) {
+         set_result(out_bitmap, i + j, this->has(hashes[group][j]));
+      }
+      count = next_count;
+   }
+}
+
+void BlockedBloomFilter::add_many(const uint64_t* keys, size_t n) {
+   if (batch_avx2) this->add_batch<true>(keys, n);
+   else this->add_batch<false>(keys, n);
+}
+
+void BlockedBloomFilter::has_many(const uint64_t* keys, size_t n, uint64_t* out_bitmap) {
+   if (batch_avx2) this->has_batch<true>(keys, n, out_bitmap);
+   else this->has_batch<false>(keys, n, out_bitmap);
+}
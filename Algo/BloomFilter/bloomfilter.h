@@ -0,0 +1,249 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "./hashing.h"
+
+struct BloomFilterSize {
+   size_t m, k;
+   BloomFilterSize(size_t capacity, double errRate) {
+      double factor = log(1.0 / (pow(2.0, log(2.0))));
+      this->m = size_t(ceil((double(capacity) * log(errRate)) / factor));
+      this->k = size_t(ceil(log(2.0) * double(m) / double(capacity)));
+   }
+   void print() {
+      printf("BloomFilter size: n_bits=%zu, n_hash=%zu\n", m, k);
+   }
+};
+
+// Cache line aligned allocation for filter storage
+inline void* bloom_aligned_alloc(size_t size, size_t alignment = 64) {
+#if defined(_WIN32)
+   void* ptr = _aligned_malloc(size, alignment);
+#else
+   void* ptr = 0;
+   if (posix_memalign(&ptr, alignment, size)) ptr = 0;
+#endif
+   if (!ptr) throw "out of memory";
+   return ptr;
+}
+inline void bloom_aligned_free(void* ptr) {
+#if defined(_WIN32)
+   _aligned_free(ptr);
+#else
+   free(ptr);
+#endif
+}
+
+// Probes are derived from one 64 bits hash by double hashing (Kirsch-Mitzenmacher):
+// probe i is h1 + i * h2, reduced on the filter range with fastrange
+// instead of a modulo.
+
+// Flat layout: the k bits of an entry are spread over the whole bitmap,
+// so each probe may touch a different cache line
+class BloomFilter {
+public:
+   static const size_t BitmapBits = sizeof(uint64_t) * 8;
+   const size_t m; // Number of bits in filter, ie. number of hash possible values
+   const size_t k; // Number of hash functions per entry
+   const uint64_t seed; // Seed of the key hashing
+private:
+   uint64_t* bitmaps;
+   size_t bitmapCount;
+   bool owned; // Storage allocated by the filter, or external view
+
+   void add_bit(uint64_t bit) {
+      this->bitmaps[bit / BitmapBits] |= (uint64_t(1) << (bit % BitmapBits));
+   }
+   uint64_t has_bit(uint64_t bit) {
+      return this->bitmaps[bit / BitmapBits] & (uint64_t(1) << (bit % BitmapBits));
+   }
+   void init(void* storage) {
+      if (m == 0 || k == 0) throw "empty filter";
+      this->bitmapCount = (m + BitmapBits - 1) / BitmapBits;
+      this->owned = !storage;
+      if (storage) {
+         this->bitmaps = (uint64_t*)storage;
+      }
+      else {
+         this->bitmaps = (uint64_t*)bloom_aligned_alloc(this->memory());
+         this->clear();
+      }
+   }
+public:
+   BloomFilter(BloomFilterSize sz, uint64_t seed = 0) : m(sz.m), k(sz.k), seed(seed) {
+      this->init(0);
+   }
+   // When storage is given, the filter is a view on an external storage
+   // of memory() bytes, not owned nor cleared
+   BloomFilter(size_t m, size_t k, uint64_t seed = 0, void* storage = 0) : m(m), k(k), seed(seed) {
+      this->init(storage);
+   }
+   BloomFilter(const BloomFilter&) = delete;
+   BloomFilter& operator = (const BloomFilter&) = delete;
+   ~BloomFilter() {
+      if (this->owned) bloom_aligned_free(this->bitmaps);
+   }
+   size_t memory() const {
+      return this->bitmapCount * sizeof(uint64_t);
+   }
+   const void* data() const {
+      return this->bitmaps;
+   }
+   void clear() {
+      memset(this->bitmaps, 0, this->memory());
+   }
+   void add(uint64_t hash) {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      for (size_t i = 0; i < k; i++) {
+         this->add_bit(fastrange64(hash, m));
+         hash += delta;
+      }
+   }
+   bool has(uint64_t hash) {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      for (size_t i = 0; i < k; i++) {
+         if (!this->has_bit(fastrange64(hash, m))) return false;
+         hash += delta;
+      }
+      return true;
+   }
+   void add(const void* key, size_t length) {
+      this->add(hash64(key, length, seed));
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+
+   // Batched operations on 64 bits integer keys (hashed as add(&key, sizeof(key))),
+   // the probe positions of a group of keys are computed and prefetched
+   // while the previous group is tested. On a filter larger than the caches,
+   // has_many prefetches the remaining probes only for the keys whose
+   // first probes are set.
+   // has_many sets bit i of out_bitmap when keys[i] may be in the filter.
+   void add_many(const uint64_t* keys, size_t n);
+   void has_many(const uint64_t* keys, size_t n, uint64_t* out_bitmap);
+
+   // Select the AVX2 or scalar key hashing of the batch operations of both
+   // layouts (AVX2 is used only when supported, and by default),
+   // return the name of the selected path
+   static const char* use_simd(bool enabled);
+
+private:
+   // Batch loops, instantiated for the scalar and AVX2 hashing
+   template <bool AVX2> void probe_batch(const uint64_t* keys, size_t count, uint64_t* bits, size_t prefetched);
+   template <bool AVX2> void add_batch(const uint64_t* keys, size_t n);
+   template <bool AVX2> void has_batch(const uint64_t* keys, size_t n, uint64_t* out_bitmap);
+   template <bool AVX2> void has_staged(const uint64_t* keys, size_t n, uint64_t* out_bitmap);
+   uint64_t has_bits(const uint64_t* bits, size_t first, size_t last);
+};
+
+// Blocked layout: the k bits of an entry all land in one 64-byte block,
+// so a lookup costs a single cache miss whatever k is.
+// The hash selects the block, then the bits inside the block are derived
+// from its low half by double hashing.
+class BlockedBloomFilter {
+public:
+   static const size_t BlockBytes = 64;
+   static const size_t BlockBits = BlockBytes * 8;
+   static const size_t WordBits = sizeof(uint64_t) * 8;
+   struct Block {
+      uint64_t words[BlockBytes / sizeof(uint64_t)];
+   };
+   const size_t m; // Number of bits in filter, rounded up to whole blocks
+   const size_t k; // Number of hash functions per entry
+   const uint64_t seed; // Seed of the key hashing
+private:
+   Block* blocks;
+   size_t blockCount;
+   bool owned; // Storage allocated by the filter, or external view
+
+   Block& block_of(uint64_t hash) {
+      return this->blocks[fastrange64(hash, this->blockCount)];
+   }
+   static uint32_t delta_of(uint64_t hash) {
+      return uint32_t((hash * 0x9e3779b97f4a7c15ull) >> 32) | 1;
+   }
+   static void add_bit(Block& block, uint32_t hash) {
+      uint32_t bit = hash >> 23; // top 9 bits, ie. [0, BlockBits)
+      block.words[bit / WordBits] |= (uint64_t(1) << (bit % WordBits));
+   }
+   static uint64_t has_bit(const Block& block, uint32_t hash) {
+      uint32_t bit = hash >> 23;
+      return block.words[bit / WordBits] & (uint64_t(1) << (bit % WordBits));
+   }
+   static size_t blocks_for(size_t m) {
+      return (m + BlockBits - 1) / BlockBits;
+   }
+
+
+   // Batch loops, instantiated for the scalar and AVX2 hashing
+   template <bool AVX2> void add_batch(const uint64_t* keys, size_t n);
+   template <bool AVX2> void has_batch(const uint64_t* keys, size_t n, uint64_t* out_bitmap);
+public:
+   BlockedBloomFilter(BloomFilterSize sz, uint64_t seed = 0) : BlockedBloomFilter(sz.m, sz.k, seed) {
+   }
+   // When storage is given, the filter is a view on an external storage
+   // of memory() bytes aligned on BlockBytes, not owned nor cleared
+   BlockedBloomFilter(size_t m, size_t k, uint64_t seed = 0, void* storage = 0) : m(blocks_for(m) * BlockBits), k(k), seed(seed) {
+      if (m == 0 || k == 0) throw "empty filter";
+      this->blockCount = blocks_for(m);
+      this->owned = !storage;
+      if (storage) {
+         this->blocks = (Block*)storage;
+      }
+      else {
+         this->blocks = (Block*)bloom_aligned_alloc(this->memory(), BlockBytes);
+         this->clear();
+      }
+   }
+   BlockedBloomFilter(const BlockedBloomFilter&) = delete;
+   BlockedBloomFilter& operator = (const BlockedBloomFilter&) = delete;
+   ~BlockedBloomFilter() {
+      if (this->owned) bloom_aligned_free(this->blocks);
+   }
+   size_t memory() const {
+      return this->blockCount * sizeof(Block);
+   }
+   const void* data() const {
+      return this->blocks;
+   }
+   void clear() {
+      memset(this->blocks, 0, this->memory());
+   }
+   void add(uint64_t hash) {
+      Block& block = this->block_of(hash);
+      uint32_t h = uint32_t(hash), delta = delta_of(hash);
+      for (size_t i = 0; i < k; i++) {
+         add_bit(block, h);
+         h += delta;
+      }
+   }
+   bool has(uint64_t hash) {
+      Block& block = this->block_of(hash);
+      uint32_t h = uint32_t(hash), delta = delta_of(hash);
+      for (size_t i = 0; i < k; i++) {
+         if (!has_bit(block, h)) return false;
+         h += delta;
+      }
+      return true;
+   }
+   void add(const void* key, size_t length) {
+      this->add(hash64(key, length, seed));
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+
+   // Batched operations on 64 bits integer keys (hashed as add(&key, sizeof(key))),
+   // the blocks of the next group of keys are prefetched while the current
+   // one is tested.
+   // has_many sets bit i of out_bitmap when keys[i] may be in the filter.
+   void add_many(const uint64_t* keys, size_t n);
+   void has_many(const uint64_t* keys, size_t n, uint64_t* out_bitmap);
+
+   // Same switch as BloomFilter::use_simd
+   static const char* use_simd(bool enabled);
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include "./bloomfilter.h"
+
+// Blocked bloom filter shared by many threads without lock:
+// - writers set the bits of a block word with a relaxed fetch_or, skipped
+//   when the bits are already set so that hot blocks stay in shared state
+// - readers use relaxed loads, a key is visible to a reader once its add()
+//   happens-before the has() (ie. after a join or any other synchronization)
+// Probes are the same than BlockedBloomFilter ones.
+class ConcurrentBloomFilter {
+public:
+   static const size_t BlockBytes = 64;
+   static const size_t BlockBits = BlockBytes * 8;
+   static const size_t WordBits = sizeof(uint64_t) * 8;
+   static const size_t BlockWords = BlockBytes / sizeof(uint64_t);
+   struct Block {
+      std::atomic<uint64_t> words[BlockWords];
+   };
+   const size_t m; // Number of bits in filter, rounded up to whole blocks
+   const size_t k; // Number of hash functions per entry
+   const uint64_t seed; // Seed of the key hashing
+private:
+   Block* blocks;
+   size_t blockCount;
+
+   Block& block_of(uint64_t hash) {
+      return this->blocks[fastrange64(hash, this->blockCount)];
+   }
+   static uint32_t delta_of(uint64_t hash) {
+      return uint32_t((hash * 0x9e3779b97f4a7c15ull) >> 32) | 1;
+   }
+   // Gather the k probes of a hash as one mask per block word
+   void masks_of(uint64_t hash, uint64_t masks[BlockWords]) {
+      uint32_t h = uint32_t(hash), delta = delta_of(hash);
+      for (size_t i = 0; i < BlockWords; i++) masks[i] = 0;
+      for (size_t i = 0; i < k; i++) {
+         uint32_t bit = h >> 23;
+         masks[bit / WordBits] |= (uint64_t(1) << (bit % WordBits));
+         h += delta;
+      }
+   }
+   static size_t blocks_for(size_t m) {
+      return (m + BlockBits - 1) / BlockBits;
+   }
+public:
+   ConcurrentBloomFilter(BloomFilterSize sz, uint64_t seed = 0) : ConcurrentBloomFilter(sz.m, sz.k, seed) {
+   }
+   ConcurrentBloomFilter(size_t m, size_t k, uint64_t seed = 0) : m(blocks_for(m) * BlockBits), k(k), seed(seed) {
+      if (m == 0 || k == 0) throw "empty filter";
+      this->blockCount = blocks_for(m);
+      this->blocks = (Block*)bloom_aligned_alloc(this->memory(), BlockBytes);
+      for (size_t i = 0; i < this->blockCount; i++) {
+         new(&this->blocks[i]) Block();
+      }
+      this->clear();
+   }
+   ConcurrentBloomFilter(const ConcurrentBloomFilter&) = delete;
+   ConcurrentBloomFilter& operator = (const ConcurrentBloomFilter&) = delete;
+   ~ConcurrentBloomFilter() {
+      bloom_aligned_free(this->blocks);
+   }
+   size_t memory() const {
+      return this->blockCount * sizeof(Block);
+   }
+   // Not thread safe: shall not run concurrently with add()
+   void clear() {
+      for (size_t i = 0; i < this->blockCount; i++) {
+         for (auto& word : this->blocks[i].words) {
+            word.store(0, std::memory_order_relaxed);
+         }
+      }
+   }
+   void add(uint64_t hash) {
+      Block& block = this->block_of(hash);
+      uint64_t masks[BlockWords];
+      this->masks_of(hash, masks);
+      for (size_t i = 0; i < BlockWords; i++) {
+         uint64_t mask = masks[i];
+         if (mask && (block.words[i].load(std::memory_order_relaxed) & mask) != mask) {
+            block.words[i].fetch_or(mask, std::memory_order_relaxed);
+         }
+      }
+   }
+   bool has(uint64_t hash) {
+      Block& block = this->block_of(hash);
+      uint64_t masks[BlockWords];
+      this->masks_of(hash, masks);
+      for (size_t i = 0; i < BlockWords; i++) {
+         uint64_t mask = masks[i];
+         if ((block.words[i].load(std::memory_order_relaxed) & mask) != mask) return false;
+      }
+      return true;
+   }
+   void add(const void* key, size_t length) {
+      this->add(hash64(key, length, seed));
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+};
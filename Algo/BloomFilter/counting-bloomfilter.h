@@ -0,0 +1,90 @@
+#pragma once
+#include "./bloomfilter.h"
+
+// Counting bloom filter: each position holds a 4 bits counter instead of a bit,
+// 16 counters packed per word, so that entries can be removed.
+// A counter reaching 15 is saturated and never decremented again,
+// remove() shall be called only for keys previously added.
+// Probes are the same than BloomFilter ones.
+class CountingBloomFilter {
+public:
+   static const size_t CounterBits = 4;
+   static const size_t CountersPerWord = sizeof(uint64_t) * 8 / CounterBits;
+   static const uint64_t CounterMax = (1 << CounterBits) - 1;
+   const size_t m; // Number of counters in filter
+   const size_t k; // Number of hash functions per entry
+   const uint64_t seed; // Seed of the key hashing
+private:
+   uint64_t* counters;
+   size_t wordCount;
+
+   uint64_t get_counter(uint64_t index) {
+      return (this->counters[index / CountersPerWord] >> (index % CountersPerWord * CounterBits)) & CounterMax;
+   }
+   void inc_counter(uint64_t index) {
+      if (this->get_counter(index) < CounterMax) {
+         this->counters[index / CountersPerWord] += uint64_t(1) << (index % CountersPerWord * CounterBits);
+      }
+   }
+   void dec_counter(uint64_t index) {
+      uint64_t value = this->get_counter(index);
+      if (value > 0 && value < CounterMax) {
+         this->counters[index / CountersPerWord] -= uint64_t(1) << (index % CountersPerWord * CounterBits);
+      }
+   }
+   void init() {
+      if (m == 0 || k == 0) throw "empty filter";
+      this->wordCount = (m + CountersPerWord - 1) / CountersPerWord;
+      this->counters = (uint64_t*)bloom_aligned_alloc(this->memory());
+      this->clear();
+   }
+public:
+   CountingBloomFilter(BloomFilterSize sz, uint64_t seed = 0) : m(sz.m), k(sz.k), seed(seed) {
+      this->init();
+   }
+   CountingBloomFilter(size_t m, size_t k, uint64_t seed = 0) : m(m), k(k), seed(seed) {
+      this->init();
+   }
+   CountingBloomFilter(const CountingBloomFilter&) = delete;
+   CountingBloomFilter& operator = (const CountingBloomFilter&) = delete;
+   ~CountingBloomFilter() {
+      bloom_aligned_free(this->counters);
+   }
+   size_t memory() const {
+      return this->wordCount * sizeof(uint64_t);
+   }
+   void clear() {
+      memset(this->counters, 0, this->memory());
+   }
+   void add(uint64_t hash) {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      for (size_t i = 0; i < k; i++) {
+         this->inc_counter(fastrange64(hash, m));
+         hash += delta;
+      }
+   }
+   void remove(uint64_t hash) {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      for (size_t i = 0; i < k; i++) {
+         this->dec_counter(fastrange64(hash, m));
+         hash += delta;
+      }
+   }
+   bool has(uint64_t hash) {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      for (size_t i = 0; i < k; i++) {
+         if (!this->get_counter(fastrange64(hash, m))) return false;
+         hash += delta;
+      }
+      return true;
+   }
+   void add(const void* key, size_t length) {
+      this->add(hash64(key, length, seed));
+   }
+   void remove(const void* key, size_t length) {
+      this->remove(hash64(key, length, seed));
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include "./hashing.h"
+
+// Count-Min sketch: depth rows of width counters, a key increments one
+// counter per row and its frequency is estimated by the minimum of them.
+// Estimates never undercount, they overcount by at most epsilon * total
+// with probability 1 - delta. Rows positions are derived from one key hash
+// by double hashing. Sketches with same dimensions and seed can be merged.
+class CountMinSketch {
+public:
+   static const uint8_t c_Version = 1;
+   const size_t width; // Counters per row
+   const size_t depth; // Number of rows
+   const uint64_t seed; // Seed of the key hashing
+private:
+   std::vector<uint32_t> counters;
+   uint64_t total;
+
+   struct Header {
+      char magic[3]; // "CMS"
+      uint8_t version;
+      uint32_t width;
+      uint32_t depth;
+      uint32_t reserved;
+      uint64_t seed;
+      uint64_t total;
+   };
+public:
+   CountMinSketch(size_t width, size_t depth, uint64_t seed = 0)
+      : width(width), depth(depth), seed(seed), counters(width * depth, 0), total(0) {
+      if (width == 0 || depth == 0) throw "empty sketch";
+   }
+   static CountMinSketch FromErrors(double epsilon, double delta, uint64_t seed = 0) {
+      return CountMinSketch(size_t(ceil(exp(1.0) / epsilon)), size_t(ceil(log(1.0 / delta))), seed);
+   }
+   size_t memory() const {
+      return this->counters.size() * sizeof(uint32_t);
+   }
+   uint64_t count() const {
+      return this->total;
+   }
+   void clear() {
+      std::fill(this->counters.begin(), this->counters.end(), 0);
+      this->total = 0;
+   }
+   void add(uint64_t hash, uint32_t count = 1) {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      uint32_t* row = this->counters.data();
+      for (size_t i = 0; i < depth; i++, row += width) {
+         row[fastrange64(hash, width)] += count;
+         hash += delta;
+      }
+      this->total += count;
+   }
+   uint32_t estimate(uint64_t hash) const {
+      uint64_t delta = (hash >> 33) | (hash << 31);
+      const uint32_t* row = this->counters.data();
+      uint32_t value = UINT32_MAX;
+      for (size_t i = 0; i < depth; i++, row += width) {
+         uint32_t counter = row[fastrange64(hash, width)];
+         if (counter < value) value = counter;
+         hash += delta;
+      }
+      return value;
+   }
+   void add(const void* key, size_t length, uint32_t count = 1) {
+      this->add(hash64(key, length, seed), count);
+   }
+   uint32_t estimate(const void* key, size_t length) const {
+      return this->estimate(hash64(key, length, seed));
+   }
+
+   // Throw when dimensions or seed differ
+   void merge(const CountMinSketch& other) {
+      if (other.width != width || other.depth != depth || other.seed != seed) throw "incompatible sketches";
+      for (size_t i = 0; i < this->counters.size(); i++) {
+         this->counters[i] += other.counters[i];
+      }
+      this->total += other.total;
+   }
+   void serialize(std::vector<uint8_t>& output) const {
+      Header header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, "CMS", 3);
+      header.version = c_Version;
+      header.width = uint32_t(width);
+      header.depth = uint32_t(depth);
+      header.seed = seed;
+      header.total = this->total;
+      output.resize(sizeof(header) + this->memory());
+      memcpy(output.data(), &header, sizeof(header));
+      memcpy(output.data() + sizeof(header), this->counters.data(), this->memory());
+   }
+   // Return null when data is not a valid serialized sketch
+   static std::unique_ptr<CountMinSketch> Deserialize(const uint8_t* data, size_t size) {
+      Header header;
+      if (size < sizeof(header)) return 0;
+      memcpy(&header, data, sizeof(header));
+      if (memcmp(header.magic, "CMS", 3) || header.version != c_Version) return 0;
+      if (!header.width || !header.depth) return 0;
+      if (size != sizeof(header) + size_t(header.width) * header.depth * sizeof(uint32_t)) return 0;
+      std::unique_ptr<CountMinSketch> sketch(new CountMinSketch(header.width, header.depth, header.seed));
+      memcpy(sketch->counters.data(), data + sizeof(header), sketch->memory());
+      sketch->total = header.total;
+      return sketch;
+   }
+};
+
+// Heavy hitters of a stream: keeps the k keys with the highest Count-Min
+// estimates seen so far, the other keys are not stored
+class HeavyHitters {
+public:
+   CountMinSketch sketch;
+   const size_t k;
+private:
+   std::vector<std::pair<uint64_t, uint32_t>> top; // (key, estimate)
+public:
+   HeavyHitters(size_t k, double epsilon = 0.0001, double delta = 0.001, uint64_t seed = 0)
+      : sketch(CountMinSketch::FromErrors(epsilon, delta, seed)), k(k) {
+   }
+   void clear() {
+      this->sketch.clear();
+      this->top.clear();
+   }
+   void add(uint64_t key) {
+      uint64_t hash = hash64(&key, sizeof(key), sketch.seed);
+      this->sketch.add(hash);
+      uint32_t estimate = this->sketch.estimate(hash);
+      size_t lowest = 0;
+      for (size_t i = 0; i < this->top.size(); i++) {
+         if (this->top[i].first == key) {
+            this->top[i].second = estimate;
+            return;
+         }
+         if (this->top[i].second < this->top[lowest].second) lowest = i;
+      }
+      if (this->top.size() < k) this->top.push_back(std::make_pair(key, estimate));
+      else if (this->top[lowest].second < estimate) this->top[lowest] = std::make_pair(key, estimate);
+   }
+   // Keys sorted by decreasing estimate
+   std::vector<std::pair<uint64_t, uint32_t>> result() const {
+      auto sorted = this->top;
+      std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) {
+         return a.second > b.second;
+      });
+      return sorted;
+   }
+};
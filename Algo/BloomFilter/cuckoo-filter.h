@@ -0,0 +1,157 @@
+#pragma once
+#include "./bloomfilter.h"
+
+// Cuckoo filter (Fan et al.): each key stores a fingerprint in one of two
+// buckets of 4 slots, so that keys can be removed. The alternate bucket is
+// derived from the fingerprint only: alt(i) = (hash(fp) - i) mod bucketCount,
+// which is its own inverse for any bucket count.
+// False positive rate is about 8 / 2^bits(TFingerprint) at full load.
+// remove() shall be called only for keys previously added.
+template <class TFingerprint = uint16_t>
+class CuckooFilter {
+public:
+   static const size_t SlotsPerBucket = 4;
+   static const size_t MaxKicks = 500;
+   struct Bucket {
+      TFingerprint slots[SlotsPerBucket];
+   };
+   const uint64_t seed; // Seed of the key hashing
+private:
+   Bucket* buckets;
+   size_t bucketCount;
+   size_t count;
+   uint64_t random;
+   struct {
+      bool used;
+      size_t index;
+      TFingerprint fingerprint;
+   } victim; // Fingerprint evicted by a failed insertion
+
+   static TFingerprint fingerprint_of(uint64_t hash) {
+      TFingerprint fp = TFingerprint(hash);
+      return fp ? fp : 1; // 0 marks empty slots
+   }
+   size_t index_of(uint64_t hash) {
+      return size_t(fastrange64(hash, this->bucketCount));
+   }
+   size_t alt_index_of(size_t index, TFingerprint fp) {
+      size_t hfp = size_t(fastrange64(hash64(uint64_t(fp)), this->bucketCount));
+      return hfp >= index ? hfp - index : hfp + this->bucketCount - index;
+   }
+   bool bucket_insert(size_t index, TFingerprint fp) {
+      for (auto& slot : this->buckets[index].slots) {
+         if (!slot) {
+            slot = fp;
+            return true;
+         }
+      }
+      return false;
+   }
+   bool bucket_has(size_t index, TFingerprint fp) {
+      const Bucket& bucket = this->buckets[index];
+      bool found = false;
+      for (size_t i = 0; i < SlotsPerBucket; i++) found |= (bucket.slots[i] == fp);
+      return found;
+   }
+   bool bucket_remove(size_t index, TFingerprint fp) {
+      for (auto& slot : this->buckets[index].slots) {
+         if (slot == fp) {
+            slot = 0;
+            return true;
+         }
+      }
+      return false;
+   }
+public:
+   CuckooFilter(size_t capacity, uint64_t seed = 0) : seed(seed) {
+      if (capacity == 0) throw "empty filter";
+      // Buckets of 4 slots accept a load factor up to 95%
+      this->bucketCount = size_t(ceil(double(capacity) / (SlotsPerBucket * 0.95)));
+      this->buckets = (Bucket*)bloom_aligned_alloc(this->memory());
+      this->clear();
+   }
+   CuckooFilter(const CuckooFilter&) = delete;
+   CuckooFilter& operator = (const CuckooFilter&) = delete;
+   ~CuckooFilter() {
+      bloom_aligned_free(this->buckets);
+   }
+   size_t memory() const {
+      return this->bucketCount * sizeof(Bucket);
+   }
+   size_t size() const {
+      return this->count;
+   }
+   void clear() {
+      memset(this->buckets, 0, this->memory());
+      this->count = 0;
+      this->random = 0x2545f4914f6cdd1dull;
+      this->victim.used = false;
+   }
+   // Return false when the filter is full, the key is kept anyway
+   // and the next insertions fail
+   bool add(uint64_t hash) {
+      if (this->victim.used) return false;
+      TFingerprint fp = fingerprint_of(hash);
+      size_t index = this->index_of(hash);
+      size_t alt_index = this->alt_index_of(index, fp);
+      this->count++;
+      if (this->bucket_insert(index, fp) || this->bucket_insert(alt_index, fp)) return true;
+
+      // Relocate existing fingerprints to their alternate bucket
+      index = (this->random & 1) ? index : alt_index;
+      for (size_t kick = 0; kick < MaxKicks; kick++) {
+         this->random ^= this->random << 13;
+         this->random ^= this->random >> 7;
+         this->random ^= this->random << 17;
+         TFingerprint& slot = this->buckets[index].slots[this->random % SlotsPerBucket];
+         TFingerprint evicted = slot;
+         slot = fp;
+         fp = evicted;
+         index = this->alt_index_of(index, fp);
+         if (this->bucket_insert(index, fp)) return true;
+      }
+      this->victim.used = true;
+      this->victim.index = index;
+      this->victim.fingerprint = fp;
+      return false;
+   }
+   bool has(uint64_t hash) {
+      TFingerprint fp = fingerprint_of(hash);
+      size_t index = this->index_of(hash);
+      size_t alt_index = this->alt_index_of(index, fp);
+      if (this->bucket_has(index, fp) || this->bucket_has(alt_index, fp)) return true;
+      return this->victim.used && this->victim.fingerprint == fp
+         && (this->victim.index == index || this->victim.index == alt_index);
+   }
+   bool remove(uint64_t hash) {
+      TFingerprint fp = fingerprint_of(hash);
+      size_t index = this->index_of(hash);
+      size_t alt_index = this->alt_index_of(index, fp);
+      if (this->victim.used && this->victim.fingerprint == fp
+         && (this->victim.index == index || this->victim.index == alt_index)) {
+         this->victim.used = false;
+      }
+      else if (!this->bucket_remove(index, fp) && !this->bucket_remove(alt_index, fp)) {
+         return false;
+      }
+      this->count--;
+      // Room was made: give the victim a new chance
+      if (this->victim.used) {
+         size_t victim_alt_index = this->alt_index_of(this->victim.index, this->victim.fingerprint);
+         if (this->bucket_insert(this->victim.index, this->victim.fingerprint)
+            || this->bucket_insert(victim_alt_index, this->victim.fingerprint)) {
+            this->victim.used = false;
+         }
+      }
+      return true;
+   }
+   bool add(const void* key, size_t length) {
+      return this->add(hash64(key, length, seed));
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+   bool remove(const void* key, size_t length) {
+      return this->remove(hash64(key, length, seed));
+   }
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "./bloomfilter.h"
+#include "./cuckoo-filter.h"
+#include "./binaryfuse-filter.h"
+
+// Common interface of the set membership filters on 64 bits integer keys,
+// so that the engines can be chosen per workload
+class IFilter {
+public:
+   virtual ~IFilter() {}
+   virtual const char* getName() = 0;
+   virtual size_t memory() = 0; // Footprint in bytes
+   virtual void build(const uint64_t* keys, size_t n) = 0; // Replace the content by the keys set
+   virtual bool has(uint64_t key) = 0;
+};
+
+// Engine for the bloom filters: BloomFilter, BlockedBloomFilter
+template <class TFilter>
+class BloomFilterEngine : public IFilter {
+   const char* name;
+public:
+   TFilter filter;
+   BloomFilterEngine(const char* name, BloomFilterSize size) : name(name), filter(size) {
+   }
+   virtual const char* getName() override {
+      return this->name;
+   }
+   virtual size_t memory() override {
+      return this->filter.memory();
+   }
+   virtual void build(const uint64_t* keys, size_t n) override {
+      this->filter.clear();
+      this->filter.add_many(keys, n);
+   }
+   virtual bool has(uint64_t key) override {
+      return this->filter.has(&key, sizeof(key));
+   }
+};
+
+// Engine for the CuckooFilter
+template <class TFingerprint>
+class CuckooFilterEngine : public IFilter {
+   const char* name;
+public:
+   CuckooFilter<TFingerprint> filter;
+   CuckooFilterEngine(const char* name, size_t capacity) : name(name), filter(capacity) {
+   }
+   virtual const char* getName() override {
+      return this->name;
+   }
+   virtual size_t memory() override {
+      return this->filter.memory();
+   }
+   virtual void build(const uint64_t* keys, size_t n) override {
+      this->filter.clear();
+      for (size_t i = 0; i < n; i++) {
+         if (!this->filter.add(&keys[i], sizeof(uint64_t))) throw "cuckoo filter full";
+      }
+   }
+   virtual bool has(uint64_t key) override {
+      return this->filter.has(&key, sizeof(key));
+   }
+};
+
+// Engine for the static BinaryFuseFilter
+class BinaryFuseFilterEngine : public IFilter {
+public:
+   BinaryFuseFilter filter;
+   virtual const char* getName() override {
+      return "BinaryFuse8";
+   }
+   virtual size_t memory() override {
+      return this->filter.memory();
+   }
+   virtual void build(const uint64_t* keys, size_t n) override {
+      this->filter.build(keys, n);
+   }
+   virtual bool has(uint64_t key) override {
+      return this->filter.has(&key, sizeof(key));
+   }
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// High 64 bits of the 128 bits product a * b
+inline uint64_t mulhi64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+   return uint64_t((unsigned __int128)(a) * b >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+   return __umulh(a, b);
+#else
+   uint64_t a_lo = uint32_t(a), a_hi = a >> 32;
+   uint64_t b_lo = uint32_t(b), b_hi = b >> 32;
+   uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi;
+   uint64_t cross = (lo_lo >> 32) + uint32_t(hi_lo) + lo_hi;
+   return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+// Count of leading zero bits, 64 for 0
+inline int clz64(uint64_t x) {
+   if (!x) return 64;
+#if defined(__GNUC__) || defined(__clang__)
+   return __builtin_clzll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+   unsigned long index;
+   _BitScanReverse64(&index, x);
+   return 63 - int(index);
+#else
+   int count = 0;
+   for (; !(x & (uint64_t(1) << 63)); x <<= 1) count++;
+   return count;
+#endif
+}
+
+// Map a hash on [0, range) without division (Lemire's fastrange)
+inline uint32_t fastrange32(uint32_t hash, uint32_t range) {
+   return uint32_t((uint64_t(hash) * range) >> 32);
+}
+inline uint64_t fastrange64(uint64_t hash, uint64_t range) {
+   return mulhi64(hash, range);
+}
+
+// Finalizer of MurmurHash3, full avalanche of a 64 bits value
+inline uint64_t hash64(uint64_t x) {
+   x ^= x >> 33;
+   x *= 0xff51afd7ed558ccdull;
+   x ^= x >> 33;
+   x *= 0xc4ceb9fe1a85ec53ull;
+   x ^= x >> 33;
+   return x;
+}
+
+// Fast non-cryptographic hash of a byte key (MurmurHash64A block mixing)
+inline uint64_t hash64(const void* data, size_t length, uint64_t seed = 0) {
+   const uint64_t mul = 0xc6a4a7935bd1e995ull;
+   const uint8_t* bytes = (const uint8_t*)data;
+   uint64_t h = seed ^ (length * mul);
+   for (; length >= 8; length -= 8, bytes += 8) {
+      uint64_t v;
+      memcpy(&v, bytes, 8);
+      v *= mul;
+      v ^= v >> 47;
+      v *= mul;
+      h ^= v;
+      h *= mul;
+   }
+   if (length) {
+      uint64_t v = 0;
+      memcpy(&v, bytes, length);
+      h ^= v;
+      h *= mul;
+   }
+   return hash64(h);
+}
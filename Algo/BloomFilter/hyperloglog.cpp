@@ -0,0 +1,175 @@
+#include "./hyperloglog.h"
+#include "./simd.h"
+#include <algorithm>
+#include <math.h>
+
+static const bool cpu_has_avx2 = CpuHasAVX2();
+
+// Serialized sketch header, followed by the sparse entries or the registers
+struct HyperLogLogHeader {
+   char magic[3]; // "HLL"
+   uint8_t version;
+   uint8_t p;
+   uint8_t dense;
+   uint8_t reserved[2];
+   uint64_t seed;
+   uint32_t count; // Count of sparse entries or of registers
+};
+
+HyperLogLog::HyperLogLog(uint8_t p, uint64_t seed) : p(p), seed(seed) {
+   if (p < MinPrecision || p > MaxPrecision) throw "bad precision";
+   this->sparseSorted = 0;
+}
+
+void HyperLogLog::clear() {
+   this->registers.clear();
+   this->registers.shrink_to_fit();
+   this->sparse.clear();
+   this->sparseSorted = 0;
+}
+
+// Sort & deduplicate the sparse entries, keeping the max rank per register,
+// switch to dense registers when the list stays too large
+void HyperLogLog::compact() {
+   std::sort(this->sparse.begin(), this->sparse.end());
+   size_t count = 0;
+   for (size_t i = 0; i < this->sparse.size(); i++) {
+      uint32_t entry = this->sparse[i];
+      if (count && (this->sparse[count - 1] >> 8) == (entry >> 8)) this->sparse[count - 1] = entry;
+      else this->sparse[count++] = entry;
+   }
+   this->sparse.resize(count);
+   this->sparseSorted = count;
+   if (count > this->sparse_limit() / 2) this->to_dense();
+}
+
+void HyperLogLog::to_dense() {
+   this->registers.assign(size_t(1) << p, 0);
+   for (uint32_t entry : this->sparse) {
+      uint8_t& reg = this->registers[entry >> 8];
+      if (reg < uint8_t(entry)) reg = uint8_t(entry);
+   }
+   this->sparse.clear();
+   this->sparse.shrink_to_fit();
+   this->sparseSorted = 0;
+}
+
+double HyperLogLog::estimate() {
+   double m = double(size_t(1) << p);
+   if (this->isSparse()) {
+      // Linear counting on the set registers
+      if (this->sparseSorted != this->sparse.size()) this->compact();
+      if (this->isSparse()) return m * log(m / (m - double(this->sparse.size())));
+   }
+   double sum = 0.0;
+   size_t zeros = 0;
+   for (uint8_t reg : this->registers) {
+      sum += ldexp(1.0, -int(reg));
+      zeros += (reg == 0);
+   }
+   double alpha = (p == 4) ? 0.673 : (p == 5) ? 0.697 : (p == 6) ? 0.709 : 0.7213 / (1.0 + 1.079 / m);
+   double estimate = alpha * m * m / sum;
+   if (estimate <= 2.5 * m && zeros) {
+      estimate = m * log(m / double(zeros));
+   }
+   return estimate;
+}
+
+/*******************************************************
+**** Merge
+*******************************************************/
+#if BLOOM_X86
+BLOOM_TARGET_AVX2 static void MergeRegistersAVX2(uint8_t* registers, const uint8_t* other, size_t count) {
+   size_t i = 0;
+   for (; i + 32 <= count; i += 32) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)&registers[i]);
+      __m256i b = _mm256_loadu_si256((const __m256i*)&other[i]);
+      _mm256_storeu_si256((__m256i*)&registers[i], _mm256_max_epu8(a, b));
+   }
+   for (; i < count; i++) registers[i] = std::max(registers[i], other[i]);
+}
+static void MergeRegistersSSE2(uint8_t* registers, const uint8_t* other, size_t count) {
+   size_t i = 0;
+   for (; i + 16 <= count; i += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i*)&registers[i]);
+      __m128i b = _mm_loadu_si128((const __m128i*)&other[i]);
+      _mm_storeu_si128((__m128i*)&registers[i], _mm_max_epu8(a, b));
+   }
+   for (; i < count; i++) registers[i] = std::max(registers[i], other[i]);
+}
+#endif
+
+void HyperLogLog::merge_dense(const uint8_t* other) {
+   if (this->isSparse()) this->to_dense();
+   size_t count = this->registers.size();
+#if BLOOM_X86
+   if (cpu_has_avx2) MergeRegistersAVX2(this->registers.data(), other, count);
+   else MergeRegistersSSE2(this->registers.data(), other, count);
+#else
+   for (size_t i = 0; i < count; i++) this->registers[i] = std::max(this->registers[i], other[i]);
+#endif
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+   if (other.p != this->p || other.seed != this->seed) throw "incompatible sketches";
+   if (!other.isSparse()) {
+      this->merge_dense(other.registers.data());
+   }
+   else if (!this->isSparse()) {
+      for (uint32_t entry : other.sparse) {
+         uint8_t& reg = this->registers[entry >> 8];
+         if (reg < uint8_t(entry)) reg = uint8_t(entry);
+      }
+   }
+   else {
+      this->sparse.insert(this->sparse.end(), other.sparse.begin(), other.sparse.end());
+      this->compact();
+   }
+}
+
+/*******************************************************
+**** Serialization
+*******************************************************/
+void HyperLogLog::serialize(std::vector<uint8_t>& output) {
+   if (this->isSparse()) this->compact();
+   HyperLogLogHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, "HLL", 3);
+   header.version = c_Version;
+   header.p = this->p;
+   header.dense = !this->isSparse();
+   header.seed = this->seed;
+   header.count = uint32_t(header.dense ? this->registers.size() : this->sparse.size());
+
+   const uint8_t* payload = header.dense ? this->registers.data() : (const uint8_t*)this->sparse.data();
+   size_t payloadSize = header.dense ? this->registers.size() : this->sparse.size() * sizeof(uint32_t);
+   output.resize(sizeof(header) + payloadSize);
+   memcpy(output.data(), &header, sizeof(header));
+   if (payloadSize) memcpy(output.data() + sizeof(header), payload, payloadSize);
+}
+
+std::unique_ptr<HyperLogLog> HyperLogLog::Deserialize(const uint8_t* data, size_t size) {
+   HyperLogLogHeader header;
+   if (size < sizeof(header)) return 0;
+   memcpy(&header, data, sizeof(header));
+   if (memcmp(header.magic, "HLL", 3) || header.version != c_Version) return 0;
+   if (header.p < MinPrecision || header.p > MaxPrecision) return 0;
+   size_t registerCount = size_t(1) << header.p;
+   size_t payloadSize = header.dense ? registerCount : size_t(header.count) * sizeof(uint32_t);
+   if ((header.dense && header.count != registerCount) || size != sizeof(header) + payloadSize) return 0;
+
+   std::unique_ptr<HyperLogLog> sketch(new HyperLogLog(header.p, header.seed));
+   data += sizeof(header);
+   if (header.dense) {
+      sketch->registers.assign(data, data + registerCount);
+   }
+   else {
+      sketch->sparse.resize(header.count);
+      if (payloadSize) memcpy(sketch->sparse.data(), data, payloadSize);
+      for (uint32_t entry : sketch->sparse) {
+         if ((entry >> 8) >= registerCount) return 0;
+      }
+      sketch->compact();
+   }
+   return sketch;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include "./hashing.h"
+
+// HyperLogLog distinct count estimator with 2^p registers.
+// Small cardinalities are kept in a sparse list of (register, rank) entries,
+// converted to one byte per register once the list would outgrow it.
+// Sketches with the same precision and seed can be merged, eg. per-thread
+// sketches serialized then combined. Standard error is about 1.04 / sqrt(2^p).
+class HyperLogLog {
+public:
+   static const uint8_t c_Version = 1;
+   static const uint8_t MinPrecision = 4;
+   static const uint8_t MaxPrecision = 18;
+   const uint8_t p; // Precision: 2^p registers
+   const uint64_t seed; // Seed of the key hashing
+private:
+   std::vector<uint8_t> registers; // Dense mode: rank per register, empty in sparse mode
+   std::vector<uint32_t> sparse; // Sparse mode: index << 8 | rank entries
+   size_t sparseSorted; // Count of sorted and unique entries at the head of sparse
+
+   size_t sparse_limit() const {
+      return (size_t(1) << p) / sizeof(uint32_t);
+   }
+   void compact();
+   void to_dense();
+   void merge_dense(const uint8_t* other);
+public:
+   HyperLogLog(uint8_t p = 14, uint64_t seed = 0);
+
+   bool isSparse() const {
+      return this->registers.empty();
+   }
+   size_t memory() const {
+      return this->registers.size() + this->sparse.capacity() * sizeof(uint32_t);
+   }
+   void clear();
+   void add(uint64_t hash) {
+      uint32_t index = uint32_t(hash >> (64 - p));
+      // Guard bit so that the rank stays under 64 - p + 1
+      uint8_t rank = uint8_t(clz64((hash << p) | (uint64_t(1) << (p - 1))) + 1);
+      if (!this->isSparse()) {
+         if (this->registers[index] < rank) this->registers[index] = rank;
+         return;
+      }
+      this->sparse.push_back(index << 8 | rank);
+      if (this->sparse.size() >= this->sparse_limit()) this->compact();
+   }
+   void add(const void* key, size_t length) {
+      this->add(hash64(key, length, seed));
+   }
+   double estimate();
+
+   // Throw when precision or seed differ
+   void merge(const HyperLogLog& other);
+   void serialize(std::vector<uint8_t>& output);
+   // Return null when data is not a valid serialized sketch
+   static std::unique_ptr<HyperLogLog> Deserialize(const uint8_t* data, size_t size);
+};
@@ -1,95 +1,406 @@
+
 #include <sstream>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <math.h>
+#include <time.h>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include "./hashing.h"
+#include "./bloomfilter.h"
+#include "./concurrent-bloomfilter.h"
+#include "./counting-bloomfilter.h"
+#include "./scalable-bloomfilter.h"
+#include "./bloomfilter-file.h"
+#include "./filter.h"
+#include "./hyperloglog.h"
+#include "./countmin-sketch.h"
+#include "chrono.h"
+#include "benchmark.h"
+
+// Keys of a run are consecutive integers from a random base, so inserted
+// and queried keys never collide and the detected queries are all false positives
+static uint64_t RandomBase() {
+   srand(clock());
+   return hash64(uint64_t(rand()) << 32 | rand());
+}
+
+template <class TFilter>
+double errRate(TFilter& filter, size_t n) {
+   filter.clear();
+   uint64_t base = RandomBase();
 
-struct RandomVector {
-   uint32_t values[16];
-   RandomVector() {
-      for (int i = 0; i < 16; i++) values[i] = rand() + (rand() << 16);
+   for (uint64_t key = base; key < base + n; key++) {
+      filter.add(&key, sizeof(key));
    }
-};
 
-struct BloomFilterSize {
-   size_t m, k;
-   BloomFilterSize(int capacity, double errRate) {
-      double factor = log(1.0 / (pow(2.0, log(2.0))));
-      this->m = ceil((double(capacity) * log(errRate)) / factor);
-      this->k = ceil(log(2.0) * double(m) / capacity);
+   size_t items_count = std::min(n * 1000, size_t(10000000));
+   size_t items_detected = 0;
+   for (uint64_t key = base + n; key < base + n + items_count; key++) {
+      if (filter.has(&key, sizeof(key))) items_detected++;
    }
-   void print() {
-      printf("BloomFilter size: n_bits=%d, n_hash=%d\n", m, k);
+
+   return double(items_detected) / double(items_count);
+}
+
+// Fill the filter with n entries and build a query set where
+// half of the queries are inserted keys, half are unknown keys
+template <class TFilter>
+std::vector<uint64_t> lookupQueries(TFilter& filter, size_t n) {
+   static const size_t QueryCount = 1 << 22;
+   std::vector<uint64_t> queries(QueryCount);
+   uint64_t base = RandomBase();
+
+   filter.clear();
+   for (uint64_t key = base; key < base + n; key++) {
+      filter.add(&key, sizeof(key));
    }
-};
+   for (size_t i = 0; i < QueryCount; i++) {
+      queries[i] = (i & 1) ? base + fastrange64(hash64(i), n) : base + n + i;
+   }
+   return queries;
+}
 
-class BloomFilter {
-public:
-   static const size_t BitmapCount = 2048;
-   static const size_t BitmapBits = sizeof(size_t) * 8;
-   static const size_t MaxFilterBits = BitmapBits * BitmapCount;
-   const size_t m; // Number of bits in filter, ie. number of hash possible values
-   const size_t k; // Number of hash functions per entry
-private:
-   size_t bitmaps[BitmapCount] = { 0 };
+// Lookup throughput (in Mops) of a filter holding n entries, one key at a time
+template <class TFilter>
+double lookupRate(TFilter& filter, size_t n) {
+   std::vector<uint64_t> queries = lookupQueries(filter, n);
 
-   void add_bit(uint32_t hash) {
-      hash = hash % m;
-      this->bitmaps[hash / BitmapBits] |= (size_t(1) << (hash % BitmapBits));
+   Chrono c;
+   size_t items_detected = 0;
+   for (auto& key : queries) {
+      if (filter.has(&key, sizeof(key))) items_detected++;
    }
-   size_t has_bit(uint32_t hash) {
-      hash = hash % m;
-      return this->bitmaps[hash / BitmapBits] & (size_t(1) << (hash % BitmapBits));
+   double rate = c.GetOpsFloat(queries.size(), Chrono::Mops);
+   if (items_detected < queries.size() / 2) throw "false negative";
+   return rate;
+}
+
+// Lookup throughput (in Mops) of a filter holding n entries, with has_many
+template <class TFilter>
+double batchLookupRate(TFilter& filter, size_t n) {
+   static const size_t GroupSize = 4096;
+   std::vector<uint64_t> queries = lookupQueries(filter, n);
+   uint64_t found[GroupSize / 64];
+
+   Chrono c;
+   size_t items_detected = 0;
+   for (size_t i = 0; i < queries.size(); i += GroupSize) {
+      filter.has_many(&queries[i], GroupSize, found);
+      for (uint64_t bits : found) {
+         for (; bits; bits &= bits - 1) items_detected++;
+      }
    }
-public:
-   BloomFilter(BloomFilterSize sz) : m(sz.m), k(sz.k) {
-      if (m > MaxFilterBits) throw "too big";
+   double rate = c.GetOpsFloat(queries.size(), Chrono::Mops);
+   if (items_detected < queries.size() / 2) throw "false negative";
+   return rate;
+}
+
+// Cost of one lookup with the hardware counters, the cache and TLB misses
+// per lookup show when the filter outgrows the caches
+template <class TFilter>
+void profileLookups(const char* title, TFilter& filter, size_t n) {
+   std::vector<uint64_t> queries = lookupQueries(filter, n);
+   size_t i = 0, items_detected = 0;
+   char name[128];
+   snprintf(name, sizeof(name), "  %s n=%zu has", title, n);
+   Chrono c;
+   c.PerfTest(name, [&]() {
+      if (filter.has(&queries[i], sizeof(uint64_t))) items_detected++;
+      if (++i == queries.size()) i = 0;
+   });
+   if (items_detected == 0) throw "false negative";
+}
+
+template <class TFilter>
+void benchFilter(const char* title, TFilter& filter, size_t n) {
+   printf("%s: n=%zu, n_bits=%zu, n_hash=%zu, %zu KB\n", title, n, filter.m, filter.k, filter.memory() / 1024);
+   double rate = 100.0 * errRate(filter, n);
+   double lookups = lookupRate(filter, n);
+   double batchLookups = batchLookupRate(filter, n);
+   printf("  false positive %lg %%\n", rate);
+   printf("  lookups %.3g Mops\n", lookups);
+   printf("  batch lookups %.3g Mops\n", batchLookups);
+
+   char name[128];
+   snprintf(name, sizeof(name), "%s n=%zu false positive", title, n);
+   Benchmark::Record(name, rate, "%");
+   snprintf(name, sizeof(name), "%s n=%zu lookups", title, n);
+   Benchmark::Record(name, lookups, "Mops", false);
+   snprintf(name, sizeof(name), "%s n=%zu batch lookups", title, n);
+   Benchmark::Record(name, batchLookups, "Mops", false);
+   profileLookups(title, filter, n);
+}
+
+// Counting filter: false positive rate when full, then after removing half of the keys
+void benchCountingFilter(size_t capacity) {
+   CountingBloomFilter filter(BloomFilterSize(capacity, 0.01));
+   printf("Counting: n=%zu, n_counters=%zu, n_hash=%zu, %zu KB\n", capacity, filter.m, filter.k, filter.memory() / 1024);
+   printf("  false positive %lg %%\n", 100.0 * errRate(filter, capacity));
+
+   uint64_t base = RandomBase();
+   filter.clear();
+   for (uint64_t key = base; key < base + capacity; key++) {
+      filter.add(&key, sizeof(key));
    }
-   BloomFilter(size_t m, size_t k) : m(m), k(k) {
-      if (m > MaxFilterBits) throw "too big";
+   for (uint64_t key = base; key < base + capacity; key += 2) {
+      filter.remove(&key, sizeof(key));
+   }
+   size_t kept = 0, removed = 0;
+   for (uint64_t key = base; key < base + capacity; key++) {
+      if (!filter.has(&key, sizeof(key))) continue;
+      if ((key - base) & 1) kept++;
+      else removed++;
+   }
+   if (kept < capacity / 2) throw "false negative";
+   printf("  after removing half: %lg %% of removed keys still detected\n", 100.0 * removed / double(capacity / 2));
+}
+
+// Scalable filter: false positive rate and footprint as the population
+// grows past the initial capacity
+void benchScalableFilter(size_t capacity) {
+   ScalableBloomFilter filter(capacity, 0.01);
+   printf("Scalable: initial capacity=%zu, error bound %lg %%\n", capacity, 100.0 * filter.errRate);
+   for (size_t n = capacity; n <= capacity * 32; n *= 4) {
+      double rate = errRate(filter, n);
+      printf("  n=%zu: false positive %lg %%, %zu filters, %zu KB\n", n, 100.0 * rate, filter.stageCount(), filter.memory() / 1024);
+      char name[128];
+      snprintf(name, sizeof(name), "n=%zu false positive", n);
+      Benchmark::Record(name, 100.0 * rate, "%");
+   }
+}
+
+// Startup cost of a filter: rebuild from the keys vs mapping a saved file
+void benchFilterFile(size_t capacity) {
+   uint64_t base = RandomBase();
+   Chrono c;
+   BlockedBloomFilter filter(BloomFilterSize(capacity, 0.01));
+   for (uint64_t key = base; key < base + capacity; key++) {
+      filter.add(&key, sizeof(key));
    }
-   void clear() {
-      memset(this->bitmaps, 0, sizeof(bitmaps));
+   double buildTime = c.GetDiffDouble(Chrono::MS);
+   BloomFilterFile::Save(TEST_FILE_PATH, filter);
+
+   c.Start();
+   BloomFilterFile file(TEST_FILE_PATH);
+   auto mapped = file.OpenBlocked();
+   double loadTime = c.GetDiffDouble(Chrono::MS);
+   printf("File: n=%zu, %zu KB, build %lg ms, map %lg ms\n", capacity, filter.memory() / 1024, buildTime, loadTime);
+
+   // The mapped filter is read-only: query the inserted keys, first pass
+   // faults the pages in, second pass runs on the page cache
+   for (int pass = 0; pass < 2; pass++) {
+      c.Start();
+      for (uint64_t key = base; key < base + capacity; key++) {
+         if (!mapped->has(&key, sizeof(key))) throw "false negative";
+      }
+      printf("  %s lookups on mapped file %.3g Mops\n", pass ? "next" : "first", c.GetOpsFloat(capacity, Chrono::Mops));
    }
-   void add(uint32_t hashes[/*k*/]) {
-      for (size_t i = 0; i < k; i++) {
-         this->add_bit(hashes[i]);
+}
+
+// Compare the filter engines on a static set of n keys
+void benchFilterEngines(size_t n) {
+   std::vector<std::unique_ptr<IFilter>> engines;
+   engines.emplace_back(new BloomFilterEngine<BloomFilter>("Bloom 4%", BloomFilterSize(n, 0.04)));
+   engines.emplace_back(new BloomFilterEngine<BlockedBloomFilter>("BlockedBloom 4%", BloomFilterSize(n, 0.04)));
+   engines.emplace_back(new BloomFilterEngine<BloomFilter>("Bloom 0.4%", BloomFilterSize(n, 0.004)));
+   engines.emplace_back(new CuckooFilterEngine<uint8_t>("Cuckoo8", n));
+   engines.emplace_back(new CuckooFilterEngine<uint16_t>("Cuckoo16", n));
+   engines.emplace_back(new BinaryFuseFilterEngine());
+
+   uint64_t base = RandomBase();
+   std::vector<uint64_t> keys(n);
+   for (size_t i = 0; i < n; i++) keys[i] = base + i;
+   std::vector<uint64_t> queries(1 << 22);
+   for (size_t i = 0; i < queries.size(); i++) queries[i] = base + n + i;
+
+   printf("Engines: n=%zu\n", n);
+   for (auto& engine : engines) {
+      Chrono c;
+      engine->build(keys.data(), n);
+      double buildTime = c.GetDiffDouble(Chrono::MS);
+
+      for (uint64_t key : keys) {
+         if (!engine->has(key)) throw "false negative";
       }
+      c.Start();
+      size_t items_detected = 0;
+      for (uint64_t key : queries) {
+         if (engine->has(key)) items_detected++;
+      }
+      double lookupRate = c.GetOpsFloat(queries.size(), Chrono::Mops);
+
+      printf("  %-16s %.2f bits/key, false positive %.3f %%, build %lg ms, lookups %.3g Mops\n", engine->getName(),
+         8.0 * engine->memory() / double(n), 100.0 * items_detected / double(queries.size()), buildTime, lookupRate);
+      char name[128];
+      snprintf(name, sizeof(name), "%s false positive", engine->getName());
+      Benchmark::Record(name, 100.0 * items_detected / double(queries.size()), "%");
+      snprintf(name, sizeof(name), "%s lookups", engine->getName());
+      Benchmark::Record(name, lookupRate, "Mops", false);
    }
-   bool has(uint32_t hashes[/*k*/]) {
-      for (size_t i = 0; i < k; i++) {
-         if (!this->has_bit(hashes[i])) return false;
+}
+
+// Sketches on a skewed stream of n items over up to distinct keys: accuracy
+// and throughput against exact counting, then per-part sketches serialized
+// and merged as per-thread sketches would be
+void benchSketches(size_t n, size_t distinct) {
+   static const size_t Parts = 4;
+   std::vector<uint64_t> stream(n);
+   uint64_t base = RandomBase();
+   for (size_t i = 0; i < n; i++) {
+      // Log-uniform ranks: a few keys are very frequent
+      double u = double(hash64(base + i) >> 11) / double(uint64_t(1) << 53);
+      stream[i] = base + uint64_t(exp(u * log(double(distinct))));
+   }
+   printf("Sketches: n=%zu, distinct<=%zu\n", n, distinct);
+
+   Chrono c;
+   std::unordered_map<uint64_t, uint32_t> exact;
+   for (uint64_t key : stream) exact[key]++;
+   printf("  unordered_map: %.3g Mops, %zu distinct\n", c.GetOpsFloat(n, Chrono::Mops), exact.size());
+
+   HyperLogLog hll(14);
+   c.Start();
+   for (uint64_t key : stream) hll.add(&key, sizeof(key));
+   double hllRate = c.GetOpsFloat(n, Chrono::Mops);
+   double hllEstimate = hll.estimate();
+   printf("  HyperLogLog p=14: %.3g Mops, %zu bytes, estimate %.0f (error %.2f %%)\n", hllRate, hll.memory(),
+      hllEstimate, 100.0 * (hllEstimate - double(exact.size())) / double(exact.size()));
+
+   HeavyHitters hitters(10);
+   c.Start();
+   for (uint64_t key : stream) hitters.add(key);
+   double cmsRate = c.GetOpsFloat(n, Chrono::Mops);
+   std::vector<std::pair<uint64_t, uint32_t>> top(exact.begin(), exact.end());
+   std::partial_sort(top.begin(), top.begin() + 10, top.end(), [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) {
+      return a.second > b.second;
+   });
+   size_t found = 0;
+   double overcount = 0.0;
+   for (auto& hitter : hitters.result()) {
+      for (size_t i = 0; i < 10; i++) found += (top[i].first == hitter.first);
+      overcount += double(hitter.second - exact[hitter.first]) / double(exact[hitter.first]);
+   }
+   printf("  Count-Min %zux%zu top 10: %.3g Mops, %zu KB, %zu/10 exact heavy hitters, mean overcount %.3f %%\n",
+      hitters.sketch.width, hitters.sketch.depth, cmsRate, hitters.sketch.memory() / 1024, found, 10.0 * overcount);
+
+   // Merge of the serialized sketches of each part
+   HyperLogLog hllMerged(14);
+   CountMinSketch cmsMerged = CountMinSketch::FromErrors(0.0001, 0.001);
+   std::vector<uint8_t> bytes;
+   for (size_t part = 0; part < Parts; part++) {
+      HyperLogLog hllPart(14);
+      CountMinSketch cmsPart = CountMinSketch::FromErrors(0.0001, 0.001);
+      for (size_t i = n * part / Parts; i < n * (part + 1) / Parts; i++) {
+         hllPart.add(&stream[i], sizeof(uint64_t));
+         cmsPart.add(&stream[i], sizeof(uint64_t));
       }
-      return true;
+      hllPart.serialize(bytes);
+      hllMerged.merge(*HyperLogLog::Deserialize(bytes.data(), bytes.size()));
+      cmsPart.serialize(bytes);
+      cmsMerged.merge(*CountMinSketch::Deserialize(bytes.data(), bytes.size()));
    }
-   double errRate(size_t n) {
-      this->clear();
-      srand(clock());
+   if (hllMerged.estimate() != hllEstimate) throw "merged HyperLogLog differs";
+   for (auto& hitter : hitters.result()) {
+      if (cmsMerged.estimate(&hitter.first, sizeof(uint64_t)) != hitters.sketch.estimate(&hitter.first, sizeof(uint64_t))) throw "merged Count-Min differs";
+   }
+   printf("  %zu part sketches merged: same estimates\n", Parts);
+}
+
+// Insert throughput of a ConcurrentBloomFilter filled by 1 to N threads,
+// then every thread checks the keys inserted by another one
+void benchConcurrentFilter(size_t capacity) {
+   ConcurrentBloomFilter filter(BloomFilterSize(capacity, 0.01));
+   unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+   uint64_t base = RandomBase();
+   printf("Concurrent: n=%zu, n_bits=%zu, n_hash=%zu, %zu KB\n", capacity, filter.m, filter.k, filter.memory() / 1024);
 
-      for (size_t i = 0; i < n; i++) {
-         this->add(RandomVector().values);
+   for (unsigned threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+      std::vector<std::thread> workers;
+      std::atomic<size_t> missing(0);
+      auto slice = [&](unsigned index, uint64_t& first, uint64_t& last) {
+         first = base + capacity * index / threads;
+         last = base + capacity * (index + 1) / threads;
+      };
+
+      filter.clear();
+      Chrono c;
+      for (unsigned t = 0; t < threads; t++) {
+         workers.push_back(std::thread([&, t]() {
+            uint64_t first, last;
+            slice(t, first, last);
+            for (uint64_t key = first; key < last; key++) {
+               filter.add(&key, sizeof(key));
+            }
+         }));
       }
+      for (auto& worker : workers) worker.join();
+      double insertRate = c.GetOpsFloat(capacity, Chrono::Mops);
+      workers.clear();
 
-      size_t items_count = n * 1000;
-      size_t items_detected = 0;
-      for (size_t i = 0; i < items_count; i++) {
-         if (this->has(RandomVector().values)) items_detected++;
+      c.Start();
+      for (unsigned t = 0; t < threads; t++) {
+         workers.push_back(std::thread([&, t]() {
+            uint64_t first, last;
+            slice((t + 1) % threads, first, last);
+            for (uint64_t key = first; key < last; key++) {
+               if (!filter.has(&key, sizeof(key))) missing++;
+            }
+         }));
       }
+      for (auto& worker : workers) worker.join();
+      double lookupRate = c.GetOpsFloat(capacity, Chrono::Mops);
 
-      return double(items_detected) / double(items_count);
+      printf("  %u threads: inserts %.3g Mops, lookups %.3g Mops, missing %zu\n", threads, insertRate, lookupRate, missing.load());
+      char name[128];
+      snprintf(name, sizeof(name), "%u threads inserts", threads);
+      Benchmark::Record(name, insertRate, "Mops", false);
+      snprintf(name, sizeof(name), "%u threads lookups", threads);
+      Benchmark::Record(name, lookupRate, "Mops", false);
+      if (missing) throw "false negative";
+      if (threads == maxThreads) break;
    }
-};
+}
 
 void main() {
-   int n = 10000;
+   Benchmark::Register("errRate", []() {
+      int n = 10000;
 
-   BloomFilterSize bs(n, 0.04);
-   bs.print();
+      BloomFilterSize bs(n, 0.04);
+      bs.print();
 
-   //BloomFilter filter(bs);
-   BloomFilter filter(70000, 5);
-   printf("BloomFilter false positive %lg %%\n", 100.0 * filter.errRate(n));
-}
+      //BloomFilter filter(bs);
+      BloomFilter filter(70000, 5);
+      double rate = 100.0 * errRate(filter, n);
+      printf("BloomFilter false positive %lg %%\n", rate);
+      Benchmark::Record("BloomFilter false positive", rate, "%");
+   });
 
+   // Flat vs blocked layout, from cache resident to memory bound filters
+   Benchmark::Register("layouts", []() {
+      for (size_t capacity : { 100000, 1000000, 10000000 }) {
+         BloomFilterSize size(capacity, 0.01);
+         BloomFilter flat(size);
+         BlockedBloomFilter blocked(size);
+         benchFilter("Flat", flat, capacity);
+         benchFilter("Blocked", blocked, capacity);
+         const char* path = BloomFilter::use_simd(false);
+         printf("  Flat batch lookups (%s) %.3g Mops\n", path, batchLookupRate(flat, capacity));
+         printf("  Blocked batch lookups (%s) %.3g Mops\n", path, batchLookupRate(blocked, capacity));
+         BloomFilter::use_simd(true);
+      }
+   });
+
+   Benchmark::Register("counting", []() { benchCountingFilter(1000000); });
+   Benchmark::Register("scalable", []() { benchScalableFilter(100000); });
+   Benchmark::Register("file", []() { benchFilterFile(10000000); });
+   Benchmark::Register("engines", []() { benchFilterEngines(1000000); });
+   Benchmark::Register("sketches", []() { benchSketches(10000000, 1000000); });
+   Benchmark::Register("concurrent", []() { benchConcurrentFilter(10000000); });
+   Benchmark::Run("BloomFilter");
+}
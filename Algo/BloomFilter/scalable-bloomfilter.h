@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "./bloomfilter.h"
+
+// Scalable bloom filter: a chain of filters, a new one is appended when the
+// last one reaches its capacity. Filter i has a capacity of capacity * growth^i
+// and an error rate of errRate * (1 - tightening) * tightening^i, so the
+// compound false positive rate stays under errRate whatever the population.
+// All the filters are probed with the same key hash.
+class ScalableBloomFilter {
+public:
+   const size_t capacity; // Capacity of the first filter
+   const double errRate; // Upper bound of the false positive rate
+   const size_t growth; // Capacity ratio between consecutive filters
+   const double tightening; // Error rate ratio between consecutive filters
+   const uint64_t seed; // Seed of the key hashing
+private:
+   struct Stage {
+      BloomFilter filter;
+      size_t capacity;
+      size_t count;
+      Stage(size_t capacity, double errRate, uint64_t seed)
+         : filter(BloomFilterSize(capacity, errRate), seed), capacity(capacity), count(0) {
+      }
+   };
+   std::vector<std::unique_ptr<Stage>> stages;
+
+   void add_stage() {
+      size_t index = this->stages.size();
+      size_t stageCapacity = this->capacity;
+      for (size_t i = 0; i < index; i++) stageCapacity *= this->growth;
+      double stageErrRate = this->errRate * (1.0 - this->tightening) * pow(this->tightening, double(index));
+      this->stages.push_back(std::unique_ptr<Stage>(new Stage(stageCapacity, stageErrRate, this->seed)));
+   }
+public:
+   ScalableBloomFilter(size_t capacity, double errRate, size_t growth = 2, double tightening = 0.8, uint64_t seed = 0)
+      : capacity(capacity), errRate(errRate), growth(growth), tightening(tightening), seed(seed) {
+      if (capacity == 0 || growth == 0) throw "empty filter";
+      if (tightening <= 0.0 || tightening >= 1.0) throw "bad tightening ratio";
+      this->add_stage();
+   }
+   size_t memory() const {
+      size_t size = 0;
+      for (auto& stage : this->stages) size += stage->filter.memory();
+      return size;
+   }
+   size_t stageCount() const {
+      return this->stages.size();
+   }
+   void clear() {
+      this->stages.clear();
+      this->add_stage();
+   }
+   void add(uint64_t hash) {
+      // Already present keys are not inserted again, so they do not consume capacity
+      if (this->has(hash)) return;
+      Stage* stage = this->stages.back().get();
+      if (stage->count >= stage->capacity) {
+         this->add_stage();
+         stage = this->stages.back().get();
+      }
+      stage->filter.add(hash);
+      stage->count++;
+   }
+   bool has(uint64_t hash) {
+      // Latest filters hold most of the entries, probe them first
+      for (size_t i = this->stages.size(); i > 0; i--) {
+         if (this->stages[i - 1]->filter.has(hash)) return true;
+      }
+      return false;
+   }
+   void add(const void* key, size_t length) {
+      this->add(hash64(key, length, seed));
+   }
+   bool has(const void* key, size_t length) {
+      return this->has(hash64(key, length, seed));
+   }
+};
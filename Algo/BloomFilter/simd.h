@@ -0,0 +1,36 @@
+#pragma once
+
+// x86 SIMD support shared by the filters and sketches
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BLOOM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BLOOM_TARGET_AVX2
+#else
+#define BLOOM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#define BLOOM_PREFETCH(ptr) _mm_prefetch((const char*)(ptr), _MM_HINT_T0)
+#else
+#define BLOOM_X86 0
+#define BLOOM_PREFETCH(ptr) __builtin_prefetch(ptr)
+#endif
+
+// Runtime detection of AVX2, including the OS support of the YMM registers
+inline bool CpuHasAVX2() {
+#if BLOOM_X86 && defined(_MSC_VER)
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return false;
+   __cpuid(info, 1);
+   bool osxsave = (info[2] & (1 << 27)) != 0;
+   __cpuidex(info, 7, 0);
+   bool avx2 = (info[1] & (1 << 5)) != 0;
+   return avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#elif BLOOM_X86
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2");
+#else
+   return false;
+#endif
+}
@@ -0,0 +1,214 @@
+#ifndef ANCHOR_DIFF_H_
+#define ANCHOR_DIFF_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "./myers-diff.h"
+
+// Anchored diffs of interned lines, as the patience and histogram diffs of git:
+// after trimming the common prefix and suffix, the texts are split on
+// anchor lines and each side of an anchor is diffed recursively, the ranges
+// without a usable anchor are left to the Myers diff.
+// - PATIENCE: the anchors are the longest increasing sequence of the lines
+//   that occur exactly once in both ranges.
+// - HISTOGRAM: the anchor is the common region around the line of A with the
+//   fewest occurrences, which also aligns the ranges without unique lines.
+// The common pairs are appended to matches in order, they are not a minimal
+// edit script but keep the rare lines, such as the code structure, aligned.
+class AnchorDiff {
+public:
+   enum Mode {
+      PATIENCE,
+      HISTOGRAM,
+   };
+   typedef std::vector<std::pair<int, int>> Matches;
+
+   // a and b are the ids of n and m lines, all below idCount
+   static void Run(Mode mode, const uint32_t* a, int n, const uint32_t* b, int m, uint32_t idCount, Matches& matches) {
+      AnchorDiff diff(mode, a, n, b, idCount, matches);
+      diff.diff(0, n, 0, m);
+   }
+
+private:
+   static const uint32_t kMaxOccurrences = 64;   // Histogram lines more frequent are left to Myers
+
+   Mode mode;
+   const uint32_t* a;
+   const uint32_t* b;
+   Matches& matches;
+
+   // Per id, cleared after each use on the ids of the range
+   std::vector<uint32_t> countA, countB;
+   std::vector<int> lastA, lastB;   // Patience: last position in the range, histogram: first position in A
+   std::vector<int> nextA;          // Histogram: next occurrence of the same line in A, -1 at the last
+
+   AnchorDiff(Mode mode, const uint32_t* a, int n, const uint32_t* b, uint32_t idCount, Matches& matches)
+      : mode(mode), a(a), b(b), matches(matches) {
+      this->countA.resize(idCount);
+      this->lastA.resize(idCount, -1);
+      if (mode == PATIENCE) {
+         this->countB.resize(idCount);
+         this->lastB.resize(idCount, -1);
+      }
+      else {
+         this->nextA.resize(n);
+      }
+   }
+
+   void diff(int a0, int a1, int b0, int b1) {
+      // Common prefix and suffix
+      while (a0 < a1 && b0 < b1 && this->a[a0] == this->b[b0]) {
+         this->matches.push_back(std::make_pair(a0++, b0++));
+      }
+      int suffix = 0;
+      while (a0 < a1 - suffix && b0 < b1 - suffix && this->a[a1 - suffix - 1] == this->b[b1 - suffix - 1]) {
+         suffix++;
+      }
+      a1 -= suffix;
+      b1 -= suffix;
+
+      if (a0 < a1 && b0 < b1) {
+         if (this->mode == PATIENCE) this->diffPatience(a0, a1, b0, b1);
+         else this->diffHistogram(a0, a1, b0, b1);
+      }
+      for (int i = 0; i < suffix; i++) {
+         this->matches.push_back(std::make_pair(a1 + i, b1 + i));
+      }
+   }
+
+   void diffMyers(int a0, int a1, int b0, int b1) {
+      const uint32_t* a = this->a + a0;
+      const uint32_t* b = this->b + b0;
+      size_t first = this->matches.size();
+      MyersMatches(a1 - a0, b1 - b0, [a, b](int i, int j) { return a[i] == b[j]; }, this->matches);
+      for (size_t i = first; i < this->matches.size(); i++) {
+         this->matches[i].first += a0;
+         this->matches[i].second += b0;
+      }
+   }
+
+   void diffPatience(int a0, int a1, int b0, int b1) {
+      for (int i = a0; i < a1; i++) {
+         this->countA[this->a[i]]++;
+         this->lastA[this->a[i]] = i;
+      }
+      for (int j = b0; j < b1; j++) {
+         this->countB[this->b[j]]++;
+         this->lastB[this->b[j]] = j;
+      }
+
+      // Unique lines in both, in the order of A
+      std::vector<std::pair<int, int>> unique;
+      for (int i = a0; i < a1; i++) {
+         uint32_t id = this->a[i];
+         if (this->countA[id] == 1 && this->countB[id] == 1) {
+            unique.push_back(std::make_pair(i, this->lastB[id]));
+         }
+      }
+      for (int i = a0; i < a1; i++) this->countA[this->a[i]] = 0;
+      for (int j = b0; j < b1; j++) this->countB[this->b[j]] = 0;
+
+      if (unique.empty()) {
+         this->diffMyers(a0, a1, b0, b1);
+         return;
+      }
+
+      // Longest increasing sequence of the B positions, by patience sorting:
+      // tops[k] is the pair ending the best sequence of length k + 1
+      std::vector<int> tops, previous(unique.size());
+      for (int p = 0; p < int(unique.size()); p++) {
+         int j = unique[p].second;
+         auto pile = std::lower_bound(tops.begin(), tops.end(), j, [&unique](int top, int j) {
+            return unique[top].second < j;
+         });
+         previous[p] = pile == tops.begin() ? -1 : pile[-1];
+         if (pile == tops.end()) tops.push_back(p);
+         else *pile = p;
+      }
+      std::vector<int> anchors;
+      for (int p = tops.back(); p >= 0; p = previous[p]) anchors.push_back(p);
+
+      for (int k = int(anchors.size()) - 1; k >= 0; k--) {
+         int i = unique[anchors[k]].first, j = unique[anchors[k]].second;
+         this->diff(a0, i, b0, j);
+         this->matches.push_back(std::make_pair(i, j));
+         a0 = i + 1;
+         b0 = j + 1;
+      }
+      this->diff(a0, a1, b0, b1);
+   }
+
+   // The left side of each anchor is diffed recursively, the right side by
+   // the loop, so that the stack does not grow with the number of anchors
+   void diffHistogram(int a0, int a1, int b0, int b1) {
+      while (a0 < a1 && b0 < b1) {
+         // Occurrences of the lines of A, chained from the first
+         for (int i = a1 - 1; i >= a0; i--) {
+            uint32_t id = this->a[i];
+            this->nextA[i] = this->lastA[id];
+            this->lastA[id] = i;
+            this->countA[id]++;
+         }
+
+         // Region around the line of fewest occurrences, then the longest, then
+         // the closest to the middle of B: on equal regions, as in a text of
+         // distinct lines, the splits stay balanced
+         bool common = false;
+         uint32_t lowest = kMaxOccurrences;
+         int bestA = 0, bestB = 0, bestLength = 0, bestDistance = 0;
+         for (int j = b0; j < b1;) {
+            uint32_t count = this->countA[this->b[j]];
+            int nextJ = j + 1;
+            if (count) common = true;
+            if (count && count <= lowest) {
+               for (int i = this->lastA[this->b[j]]; i >= 0; i = this->nextA[i]) {
+                  int startA = i, startB = j, endA = i + 1, endB = j + 1;
+                  uint32_t regionCount = count;
+                  while (startA > a0 && startB > b0 && this->a[startA - 1] == this->b[startB - 1]) {
+                     startA--, startB--;
+                     regionCount = std::min(regionCount, this->countA[this->a[startA]]);
+                  }
+                  while (endA < a1 && endB < b1 && this->a[endA] == this->b[endB]) {
+                     regionCount = std::min(regionCount, this->countA[this->a[endA]]);
+                     endA++, endB++;
+                  }
+                  nextJ = std::max(nextJ, endB);
+                  int length = endA - startA;
+                  int distance = std::abs(startB + endB - b0 - b1);
+                  if (regionCount < lowest || (regionCount == lowest && (length > bestLength ||
+                     (length == bestLength && distance < bestDistance)))) {
+                     lowest = regionCount;
+                     bestA = startA;
+                     bestB = startB;
+                     bestLength = length;
+                     bestDistance = distance;
+                  }
+               }
+            }
+            j = nextJ;
+         }
+         for (int i = a0; i < a1; i++) {
+            this->countA[this->a[i]] = 0;
+            this->lastA[this->a[i]] = -1;
+         }
+
+         if (!bestLength) {
+            if (common) this->diffMyers(a0, a1, b0, b1);
+            return;
+         }
+         this->diff(a0, bestA, b0, bestB);
+         for (int k = 0; k < bestLength; k++) {
+            this->matches.push_back(std::make_pair(bestA + k, bestB + k));
+         }
+         // The region ends on a change and the range on the trimmed suffix,
+         // the right side needs no trimming
+         a0 = bestA + bestLength;
+         b0 = bestB + bestLength;
+      }
+   }
+};
+
+#endif
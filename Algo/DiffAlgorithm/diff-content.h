@@ -0,0 +1,245 @@
+#ifndef DIFF_CONTENT_H_
+#define DIFF_CONTENT_H_
+
+#include <stdint.h>
+#include "./textual-content.h"
+#include "./myers-diff.h"
+#include "./anchor-diff.h"
+#include "./line-interner.h"
+
+// Print the steps of the reference diff
+#define DIFF_TRACE 0
+
+struct DiffContent {
+   typedef TextualContent::Chunk Chunk;
+   struct XChunk {
+      Chunk* chunkA;
+      Chunk* chunkB;
+      XChunk(Chunk* chunkA, Chunk* chunkB) : chunkA(chunkA), chunkB(chunkB) {
+      }
+   };
+
+   enum Algorithm {
+      REFERENCE,   // O(NxM) dynamic programming, for small inputs and tests
+      MYERS,       // O((N+M)D) greedy search, linear space
+      PATIENCE,    // Anchored on the lines unique in both texts, then Myers
+      HISTOGRAM,   // Anchored on the least frequent lines, then Myers
+   };
+
+   TextualContent* textA;
+   TextualContent* textB;
+   std::vector<XChunk> chunks;
+   std::vector<uint32_t> idsA, idsB;   // Interned chunks, equal chunks have the same id
+   uint32_t distinctCount;
+   int commonCount;   // Chunks kept from A to B
+   DiffContent(TextualContent* textA, TextualContent* textB, Algorithm algorithm = MYERS)
+      : textA(textA), textB(textB), commonCount(0) {
+      if (textA->flags != textB->flags) throw "texts chunked with different options";
+      LineInterner interner(textA->chunks.size() + textB->chunks.size(), textA->flags);
+      interner.intern(textA->chunks, this->idsA);
+      interner.intern(textB->chunks, this->idsB);
+      this->distinctCount = interner.size();
+
+      if (algorithm == REFERENCE) this->diffReference();
+      else this->diffAligned(algorithm);
+   }
+
+   // Kept chunks in both texts, removed chunks of A then added chunks of B
+   // at each change
+   void diffAligned(Algorithm algorithm) {
+      std::vector<Chunk>& a = this->textA->chunks;
+      std::vector<Chunk>& b = this->textB->chunks;
+      const uint32_t* idsA = this->idsA.data();
+      const uint32_t* idsB = this->idsB.data();
+      std::vector<std::pair<int, int>> matches;
+      if (algorithm == MYERS) {
+         MyersMatches(int(a.size()), int(b.size()), [idsA, idsB](int i, int j) { return idsA[i] == idsB[j]; }, matches);
+      }
+      else {
+         AnchorDiff::Run(algorithm == PATIENCE ? AnchorDiff::PATIENCE : AnchorDiff::HISTOGRAM,
+            idsA, int(a.size()), idsB, int(b.size()), this->distinctCount, matches);
+      }
+
+      size_t posA = 0, posB = 0;
+      this->chunks.reserve(a.size() + b.size() - matches.size());
+      for (auto& match : matches) {
+         while (posA < size_t(match.first)) this->chunks.push_back(XChunk(&a[posA++], 0));
+         while (posB < size_t(match.second)) this->chunks.push_back(XChunk(0, &b[posB++]));
+         this->chunks.push_back(XChunk(&a[posA++], &b[posB++]));
+      }
+      while (posA < a.size()) this->chunks.push_back(XChunk(&a[posA++], 0));
+      while (posB < b.size()) this->chunks.push_back(XChunk(0, &b[posB++]));
+      this->commonCount = int(matches.size());
+   }
+
+   // Reference: weight of the longest common subsequence over all the (posA, posB)
+   // pairs, the chunks are not aligned
+   void diffReference() {
+      for (auto& chunk : textA->chunks) {
+         this->chunks.push_back(XChunk(&chunk, 0));
+      }
+      for (auto& chunk : textB->chunks) {
+         this->chunks.push_back(XChunk(0, &chunk));
+      }
+
+      struct tChange {
+         int32_t from;
+         int32_t chunkA;
+         int32_t chunkB;
+         tChange(int32_t from, int32_t chunkA = -1, int32_t chunkB = -1)
+            : from(from), chunkA(chunkA), chunkB(chunkB) {
+         }
+      };
+
+      struct tHead {
+         int32_t from = 0;
+         uint32_t weight = 0;
+         bool match = 1;
+      };
+
+      std::vector<tChange> changes;
+      std::vector<tHead> head, stage;
+      head.resize(textB->chunks.size() + 1);
+      stage.resize(textB->chunks.size() + 1);
+      changes.push_back(tChange(-1));
+
+      for (size_t posA = 0; posA < textA->chunks.size(); posA++) {
+#if DIFF_TRACE
+         Chunk* chunkA = &textA->chunks[posA];
+#endif
+         tHead* chead = head.data();
+         tHead* cstage = stage.data();
+#if DIFF_TRACE
+         printf("----------------------|%s\n", chunkA->str().c_str());
+#endif
+         {
+            cstage[0] = chead[0];
+#if DIFF_TRACE
+            printf("[%d,-]\t(%d)\n", posA, cstage->weight);
+#endif
+            chead++, cstage++;
+         }
+
+         for (size_t posB = 0; posB < textB->chunks.size(); posB++) {
+#if DIFF_TRACE
+            Chunk* chunkB = &textB->chunks[posB];
+#endif
+
+            // When B match A
+            if (this->idsA[posA] == this->idsB[posB]) {
+
+               // Compute weight & best path
+               int mode = 0;
+               int weight = chead[-1].weight + 1;
+               if (weight < chead[0].weight) {
+                  weight = chead[0].weight;
+                  mode = 1;
+               }
+               if (weight < cstage[-1].weight) {
+                  weight = cstage[-1].weight;
+                  mode = 2;
+               }
+               cstage[0].weight = weight;
+               cstage[0].match = 1;
+
+               // Set stage 'from'
+               int from = -1;
+               switch (mode) {
+               case 0: // match
+               {
+                  if (!chead[-1].match) { // switch matching mode
+                     from = changes.size();
+                     changes.push_back(tChange(chead[-1].from, posA - 1, posB - 1));
+                  }
+                  else {
+                     from = chead[-1].from;
+                  }
+               } break;
+               case 1:
+               {
+                  if (chead[0].match) { // switch matching mode
+                     from = changes.size();
+                     changes.push_back(tChange(chead[0].from, posA - 1, posB));
+                  }
+                  else {
+                     from = chead[0].from;
+                  }
+               } break;
+               case 2: {
+                  if (cstage[-1].match) { // switch matching mode
+                     from = changes.size();
+                     changes.push_back(tChange(cstage[-1].from, posA, posB - 1));
+                  }
+                  else {
+                     from = cstage[-1].from;
+                  }
+               } break;
+               }
+               cstage[0].from = from;
+            }
+            // When no match
+            else {
+               cstage[0].match = 0;
+               if (chead[0].weight > cstage[-1].weight) {
+                  cstage[0].weight = chead[0].weight;
+                  if (chead[0].match) {
+                     cstage[0].from = changes.size();
+                     changes.push_back(tChange(chead[0].from, posA - 1, posB));
+                  }
+                  else {
+                     cstage[0].from = chead[0].from;
+                  }
+               }
+               else {
+                  cstage[0].weight = cstage[-1].weight;
+                  if (cstage[-1].match) {
+                     cstage[0].from = changes.size();
+                     changes.push_back(tChange(cstage[-1].from, posA, posB - 1));
+                  }
+                  else {
+                     cstage[0].from = cstage[-1].from;
+                  }
+               }
+            }
+#if DIFF_TRACE
+            printf("[%d,%d]\t%d(%d)\t|%s\t%s\n", posA, posB, cstage->from, cstage->weight, chunkB->str().c_str(), cstage->match ? "=" : "+-");
+#endif
+            chead++, cstage++;
+         }
+         head.swap(stage);
+      }
+      this->commonCount = head.back().weight;
+#if DIFF_TRACE
+      tChange* cchange = &changes[head.back().from];
+      std::vector<tChange*> path;
+      for (;;) {
+         path.push_back(cchange);
+         if (cchange->from < 0) break;
+         if (cchange <= &changes[cchange->from]) break;
+         cchange = &changes[cchange->from];
+      }
+      printf("---------- result ------------\n");
+      for (int i = path.size() - 1; i >= 0; i--) {
+         tChange* cchange = path[i];
+         printf("[%d,%d] %s\n", cchange->chunkA, cchange->chunkB, i & 1 ? "+-" : "=");
+      }
+#endif
+   }
+   void print() {
+      for (auto& xchk : this->chunks) {
+         char mark = ' ';
+         Chunk* chunk = 0;
+         if (xchk.chunkA) {
+            chunk = xchk.chunkA;
+            if (!xchk.chunkB) mark = '-';
+         }
+         else {
+            chunk = xchk.chunkB;
+            mark = '+';
+         }
+         printf("%c %.*s\n", mark, chunk->end - chunk->start, chunk->start);
+      }
+   }
+};
+
+#endif
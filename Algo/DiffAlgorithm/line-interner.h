@@ -0,0 +1,94 @@
+#ifndef LINE_INTERNER_H_
+#define LINE_INTERNER_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "./textual-content.h"
+
+// Give each distinct chunk a dense 32-bit id, shared by all the texts
+// interned with the same interner: the diff then compares ids in contiguous
+// arrays. Open addressing on the chunk hashes, computed here rather than
+// when chunking, equal hashes are confirmed on the text so that a collision
+// can't merge two different chunks.
+class LineInterner {
+public:
+   typedef TextualContent::Chunk Chunk;
+
+   LineInterner(size_t expectedCount, int flags = 0) : flags(flags), count(0) {
+      size_t capacity = 16;
+      while (capacity < expectedCount * 2) capacity <<= 1;
+      this->slots.resize(capacity);
+      this->mask = capacity - 1;
+   }
+
+   // ids[i] is the id of chunks[i]. The chunks are hashed by groups before
+   // their lookups, so that the slot misses of a group overlap instead of
+   // each waiting for the hash of its chunk.
+   void intern(std::vector<Chunk>& chunks, std::vector<uint32_t>& ids) {
+      static const size_t kGroupSize = 32;
+      uint64_t hashes[kGroupSize];
+      ids.resize(chunks.size());
+      for (size_t i = 0; i < chunks.size(); i += kGroupSize) {
+         size_t count = std::min(kGroupSize, chunks.size() - i);
+         for (size_t j = 0; j < count; j++) {
+            hashes[j] = TextualContent::Hash(chunks[i + j].start, chunks[i + j].end, this->flags);
+         }
+         for (size_t j = 0; j < count; j++) {
+            ids[i + j] = this->intern(&chunks[i + j], hashes[j]);
+         }
+      }
+   }
+
+   uint32_t intern(Chunk* chunk) {
+      return this->intern(chunk, TextualContent::Hash(chunk->start, chunk->end, this->flags));
+   }
+
+   // Distinct chunks
+   uint32_t size() {
+      return this->count;
+   }
+
+private:
+   uint32_t intern(Chunk* chunk, uint64_t hash) {
+      for (size_t index = size_t(hash) & this->mask;; index = (index + 1) & this->mask) {
+         Slot& slot = this->slots[index];
+         if (!slot.chunk) {
+            slot.chunk = chunk;
+            slot.hash = hash;
+            slot.id = this->count++;
+            if (this->count * 2 > this->slots.size()) this->grow();
+            return this->count - 1;
+         }
+         if (slot.hash == hash && slot.chunk->equals(chunk, this->flags)) {
+            return slot.id;
+         }
+      }
+   }
+
+   struct Slot {
+      uint64_t hash = 0;
+      Chunk* chunk = 0;   // First chunk of the id
+      uint32_t id = 0;
+   };
+
+   std::vector<Slot> slots;
+   size_t mask;
+   int flags;
+   uint32_t count;
+
+   void grow() {
+      std::vector<Slot> previous;
+      previous.swap(this->slots);
+      this->slots.resize(previous.size() * 2);
+      this->mask = this->slots.size() - 1;
+      for (auto& slot : previous) {
+         if (!slot.chunk) continue;
+         size_t index = size_t(slot.hash) & this->mask;
+         while (this->slots[index].chunk) index = (index + 1) & this->mask;
+         this->slots[index] = slot;
+      }
+   }
+};
+
+#endif
@@ -7,237 +7,230 @@
 #include <algorithm>
 #include <functional>
 #include <unordered_map>
+#include <random>
 #include <math.h>
 #include "./samples.h"
+#include "./diff-content.h"
+#include "chrono.h"
+#include "benchmark.h"
 
 
-struct TextualContent {
+void test_sample(const char** text_sample) {
+   TextualContent doc1(text_sample[0], strlen(text_sample[0]));
+   TextualContent doc2(text_sample[1], strlen(text_sample[1]));
+   //doc1.print();
 
-   struct Text {
-      const char* start;
-      const char* end;
-      Text(const char* start, const char* end) : start(start), end(end) {
-      }
-   };
+   DiffContent diff(&doc1, &doc2);
+   diff.print();
+}
 
-   struct Chunk : Text {
-      int position;
-      int hash;
-      Chunk(int position, const char* start, const char* end) : Text(start, end), position(position) {
-         this->hash = 0;
-      }
-      std::string str() {
-         return std::string(this->start, this->length());
-      }
-      size_t length() {
-         return this->end - this->start;
-      }
-      bool equals(Chunk* other) {
-         if (this->hash != other->hash) return false;
-         if (this->length() != other->length()) return false;
-         return !strncmp(this->start, other->start, this->length());
-      }
-   };
-
-   std::vector<Chunk> chunks;
-   Text content;
-
-   TextualContent(const char* bytes, int length) : content(bytes, bytes + length) {
-      const char* prevPtr = content.start;
-      for (const char* ptr = prevPtr; ptr < content.end; ptr++) {
-         if (ptr[0] == '\n') {
-            this->chunks.push_back(Chunk(this->chunks.size(), prevPtr, ptr));
-            prevPtr = ptr + 1;
-         }
-      }
+// The aligned diffs must keep A and B whole and in order
+void check_chunks(DiffContent& diff, TextualContent& doc1, TextualContent& doc2) {
+   size_t posA = 0, posB = 0;
+   for (auto& xchk : diff.chunks) {
+      if (xchk.chunkA && xchk.chunkA != &doc1.chunks[posA++]) throw "diff misses a chunk of A";
+      if (xchk.chunkB && xchk.chunkB != &doc2.chunks[posB++]) throw "diff misses a chunk of B";
+      if (xchk.chunkA && xchk.chunkB && !xchk.chunkA->equals(xchk.chunkB, doc1.flags)) throw "diff keeps different chunks";
    }
-   void print() {
-      for (auto& chunk : this->chunks) {
-         printf("> %.*s\n", chunk.end - chunk.start, chunk.start);
-      }
+   if (posA != doc1.chunks.size() || posB != doc2.chunks.size()) throw "diff misses chunks";
+}
+
+// The Myers diff must keep as many chunks as the longest common subsequence
+// found by the reference, the anchored diffs at most as many
+void check_reference(TextualContent& doc1, TextualContent& doc2) {
+   DiffContent reference(&doc1, &doc2, DiffContent::REFERENCE);
+   DiffContent diff(&doc1, &doc2, DiffContent::MYERS);
+   if (diff.commonCount != reference.commonCount) throw "myers diff is not minimal";
+   check_chunks(diff, doc1, doc2);
+   for (auto algorithm : { DiffContent::PATIENCE, DiffContent::HISTOGRAM }) {
+      DiffContent anchored(&doc1, &doc2, algorithm);
+      if (anchored.commonCount > reference.commonCount) throw "anchored diff keeps too many chunks";
+      check_chunks(anchored, doc1, doc2);
    }
-};
-
-struct DiffContent {
-   typedef TextualContent::Chunk Chunk;
-   struct XChunk {
-      Chunk* chunkA;
-      Chunk* chunkB;
-      XChunk(Chunk* chunkA, Chunk* chunkB) : chunkA(chunkA), chunkB(chunkB) {
-      }
-   };
-
-   TextualContent* textA;
-   TextualContent* textB;
-   std::vector<XChunk> chunks;
-   DiffContent(TextualContent* textA, TextualContent* textB) : textA(textA), textB(textB) {
-      for (auto& chunk : textA->chunks) {
-         this->chunks.push_back(XChunk(&chunk, 0));
-      }
-      for (auto& chunk : textB->chunks) {
-         this->chunks.push_back(XChunk(0, &chunk));
-      }
+}
 
-      struct tChange {
-         int32_t from;
-         int32_t chunkA;
-         int32_t chunkB;
-         tChange(int32_t from, int32_t chunkA = -1, int32_t chunkB = -1)
-            : from(from), chunkA(chunkA), chunkB(chunkB) {
-         }
-      };
-
-      struct tHead {
-         int32_t from = 0;
-         uint32_t weight = 0;
-         bool match = 1;
-      };
-
-      std::vector<tChange> changes;
-      std::vector<tHead> head, stage;
-      head.resize(textB->chunks.size() + 1);
-      stage.resize(textB->chunks.size() + 1);
-      changes.push_back(tChange(-1));
-
-      for (size_t posA = 0; posA < textA->chunks.size(); posA++) {
-         Chunk* chunkA = &textA->chunks[posA];
-         tHead* chead = head.data();
-         tHead* cstage = stage.data();
-         printf("----------------------|%s\n", chunkA->str().c_str());
-         {
-            cstage[0] = chead[0];
-            printf("[%d,-]\t(%d)\n", posA, cstage->weight);
-            chead++, cstage++;
-         }
-
-         for (size_t posB = 0; posB < textB->chunks.size(); posB++) {
-            Chunk* chunkB = &textB->chunks[posB];
-
-            // When B match A
-            if (chunkA->equals(chunkB)) {
-
-               // Compute weight & best path
-               int mode = 0;
-               int weight = chead[-1].weight + 1;
-               if (weight < chead[0].weight) {
-                  weight = chead[0].weight;
-                  mode = 1;
-               }
-               if (weight < cstage[-1].weight) {
-                  weight = cstage[-1].weight;
-                  mode = 2;
-               }
-               cstage[0].weight = weight;
-               cstage[0].match = 1;
-
-               // Set stage 'from'
-               int from = -1;
-               switch (mode) {
-               case 0: // match
-               {
-                  if (!chead[-1].match) { // switch matching mode
-                     from = changes.size();
-                     changes.push_back(tChange(chead[-1].from, posA - 1, posB - 1));
-                  }
-                  else {
-                     from = chead[-1].from;
-                  }
-               } break;
-               case 1:
-               {
-                  if (chead[0].match) { // switch matching mode
-                     from = changes.size();
-                     changes.push_back(tChange(chead[0].from, posA - 1, posB));
-                  }
-                  else {
-                     from = chead[0].from;
-                  }
-               } break;
-               case 2: {
-                  if (cstage[-1].match) { // switch matching mode
-                     from = changes.size();
-                     changes.push_back(tChange(cstage[-1].from, posA, posB - 1));
-                  }
-                  else {
-                     from = cstage[-1].from;
-                  }
-               } break;
-               }
-               cstage[0].from = from;
-            }
-            // When no match
-            else {
-               cstage[0].match = 0;
-               if (chead[0].weight > cstage[-1].weight) {
-                  cstage[0].weight = chead[0].weight;
-                  if (chead[0].match) {
-                     cstage[0].from = changes.size();
-                     changes.push_back(tChange(chead[0].from, posA - 1, posB));
-                  }
-                  else {
-                     cstage[0].from = chead[0].from;
-                  }
-               }
-               else {
-                  cstage[0].weight = cstage[-1].weight;
-                  if (cstage[-1].match) {
-                     cstage[0].from = changes.size();
-                     changes.push_back(tChange(cstage[-1].from, posA, posB - 1));
-                  }
-                  else {
-                     cstage[0].from = cstage[-1].from;
-                  }
-               }
-            }
-            printf("[%d,%d]\t%d(%d)\t|%s\t%s\n", posA, posB, cstage->from, cstage->weight, chunkB->str().c_str(), cstage->match ? "=" : "+-");
-            chead++, cstage++;
-         }
-         head.swap(stage);
-      }
-      tChange* cchange = &changes[head.back().from];
-      std::vector<tChange*> path;
-      for (;;) {
-         path.push_back(cchange);
-         if (cchange->from < 0) break;
-         if (cchange <= &changes[cchange->from]) break;
-         cchange = &changes[cchange->from];
-      }
-      printf("---------- result ------------\n");
-      for (int i = path.size() - 1; i >= 0; i--) {
-         tChange* cchange = path[i];
-         printf("[%d,%d] %s\n", cchange->chunkA, cchange->chunkB, i & 1 ? "+-" : "=");
+void test_reference(const char** text_sample) {
+   TextualContent doc1(text_sample[0], strlen(text_sample[0]));
+   TextualContent doc2(text_sample[1], strlen(text_sample[1]));
+   check_reference(doc1, doc2);
+}
+
+// Whitespace and case changes only: all kept with the flags, all changed without
+void test_flags() {
+   const char* text1 = "int main() {\n   return 0;\n}\n";
+   const char* text2 = "INT main(){\n\treturn 0; \r\n}\n";
+   int flags = TextualContent::IGNORE_WHITESPACE | TextualContent::IGNORE_CASE;
+   TextualContent doc1(text1, int(strlen(text1)), flags);
+   TextualContent doc2(text2, int(strlen(text2)), flags);
+   check_reference(doc1, doc2);
+   if (DiffContent(&doc1, &doc2).commonCount != 3) throw "flags ignored";
+
+   TextualContent exact1(text1, int(strlen(text1)));
+   TextualContent exact2(text2, int(strlen(text2)));
+   check_reference(exact1, exact2);
+   if (DiffContent(&exact1, &exact2).commonCount != 1) throw "flags applied";
+}
+
+// A function added between two others: the anchored diffs keep the functions
+// aligned on their unique lines and add it as one block
+void test_anchored() {
+   const char* text1 = "void f() {\n   one();\n}\n\nvoid g() {\n   two();\n}\n";
+   const char* text2 = "void f() {\n   one();\n}\n\nvoid h() {\n   three();\n}\n\nvoid g() {\n   two();\n}\n";
+   TextualContent doc1(text1, int(strlen(text1)));
+   TextualContent doc2(text2, int(strlen(text2)));
+   check_reference(doc1, doc2);
+   for (auto algorithm : { DiffContent::PATIENCE, DiffContent::HISTOGRAM }) {
+      DiffContent diff(&doc1, &doc2, algorithm);
+      if (diff.commonCount != 7) throw "anchored diff is not minimal";
+      int hunks = 0;
+      for (size_t i = 0; i < diff.chunks.size(); i++) {
+         if (diff.chunks[i].chunkA) continue;
+         if (i == 0 || diff.chunks[i - 1].chunkA) hunks++;
+         if (hunks == 1 && i > 0 && diff.chunks[i - 1].chunkA && diff.chunks[i].chunkB->str() != "void h() {") throw "anchored diff splits the function";
       }
+      if (hunks != 1) throw "anchored diff splits the function";
    }
-   void print() {
-      for (auto& xchk : this->chunks) {
-         char mark = ' ';
-         Chunk* chunk = 0;
-         if (xchk.chunkA) {
-            chunk = xchk.chunkA;
-            if (!xchk.chunkB) mark = '-';
-         }
-         else {
-            chunk = xchk.chunkB;
-            mark = '+';
-         }
-         printf("%c %.*s\n", mark, chunk->end - chunk->start, chunk->start);
-      }
+}
+
+// Distinct lines with each adjacent pair swapped: an anchor at every other
+// line, the anchored diffs must not recurse once per anchor. Not for Myers,
+// quadratic there with as many edits as lines.
+void test_swapped(int lines) {
+   std::string text1, text2;
+   for (int i = 0; i < lines; i++) {
+      text1 += "line " + std::to_string(i) + "\n";
+      text2 += "line " + std::to_string(i ^ 1) + "\n";
    }
-};
+   TextualContent doc1(text1.c_str(), int(text1.size()));
+   TextualContent doc2(text2.c_str(), int(text2.size()));
+   for (auto algorithm : { DiffContent::PATIENCE, DiffContent::HISTOGRAM }) {
+      DiffContent diff(&doc1, &doc2, algorithm);
+      if (diff.commonCount != lines / 2) throw "swapped lines misaligned";
+      check_chunks(diff, doc1, doc2);
+   }
+}
 
-void test_sample(const char** text_sample) {
-   TextualContent doc1(text_sample[0], strlen(text_sample[0]));
-   TextualContent doc2(text_sample[1], strlen(text_sample[1]));
-   //doc1.print();
+// Random documents over a few distinct lines, to get many equal chunks
+std::string random_document(int lines, int alphabet) {
+   std::string text;
+   for (int i = 0; i < lines; i++) {
+      text += char('A' + rand() % alphabet);
+      text += '\n';
+   }
+   return text;
+}
 
-   DiffContent diff(&doc1, &doc2);
-   diff.print();
+void test_random(int count) {
+   for (int i = 0; i < count; i++) {
+      int alphabet = 2 + rand() % 6;
+      std::string text1 = random_document(rand() % 40, alphabet);
+      std::string text2 = random_document(rand() % 40, alphabet);
+      TextualContent doc1(text1.c_str(), int(text1.size()));
+      TextualContent doc2(text2.c_str(), int(text2.size()));
+      check_reference(doc1, doc2);
+   }
+   printf("%d random diffs match the reference\n", count);
+}
+
+// Two large documents of distinct lines, the second with scattered edits.
+// The edits are placed by a seeded mt19937, rand() stops at 32767 on MSVC.
+void bench_large(int lines, int edits) {
+   std::string text1, text2;
+   std::vector<int> edited(lines, 0);
+   std::mt19937 random(42);
+   std::uniform_int_distribution<int> position(0, lines - 1), edit(1, 3);
+   for (int i = 0; i < edits; i++) edited[position(random)] = edit(random);
+   for (int i = 0; i < lines; i++) {
+      std::string line = i % 4 ? "line " + std::to_string(i) + " of the document\n" : "}\n";
+      text1 += line;
+      if (edited[i] == 1) continue;   // Removed
+      if (edited[i] == 2) text2 += "changed " + line;
+      else text2 += line;
+      if (edited[i] == 3) text2 += "added line\n";
+   }
+   TextualContent doc1(text1.c_str(), int(text1.size()));
+   TextualContent doc2(text2.c_str(), int(text2.size()));
+
+   const char* names[] = { "Reference", "Myers", "Patience", "Histogram" };
+   for (auto algorithm : { DiffContent::MYERS, DiffContent::PATIENCE, DiffContent::HISTOGRAM }) {
+      Chrono c;
+      DiffContent diff(&doc1, &doc2, algorithm);
+      double ms = c.GetDiffDouble(Chrono::MS);
+      printf("%s diff %zu -> %zu lines, %u distinct, %d kept: %lg ms\n", names[algorithm], doc1.chunks.size(),
+         doc2.chunks.size(), diff.distinctCount, diff.commonCount, ms);
+      Benchmark::Record((std::string(names[algorithm]) + " diff").c_str(), ms, "ms");
+   }
+}
+
+// File content: CRLF lines and a last line without newline, chunked as in memory
+void test_file() {
+   const char* text = "first\r\nsecond\n\r\nlast";
+   FILE* file = fopen(TEST_FILE_PATH, "wb");
+   if (!file) throw "cannot write test file";
+   fwrite(text, 1, strlen(text), file);
+   fclose(file);
+
+   TextualContent mapped((TextualContent::FilePath(TEST_FILE_PATH)));
+   TextualContent memory(text, int(strlen(text)));
+   const char* lines[] = { "first", "second", "", "last" };
+   if (mapped.chunks.size() != 4 || memory.chunks.size() != 4) throw "bad line count";
+   for (int i = 0; i < 4; i++) {
+      if (mapped.chunks[i].str() != lines[i] || memory.chunks[i].str() != lines[i]) throw "bad line";
+   }
+   remove(TEST_FILE_PATH);
+}
+
+// Chunking throughput of a large mapped file
+void bench_file(size_t size) {
+   std::string text;
+   text.reserve(size + 200);
+   while (text.size() < size) {
+      text += "log line " + std::to_string(text.size()) + std::string(rand() % 80, '.') + "\n";
+   }
+   FILE* file = fopen(TEST_FILE_PATH, "wb");
+   if (!file) throw "cannot write test file";
+   fwrite(text.data(), 1, text.size(), file);
+   fclose(file);
+
+   Chrono c;
+   size_t count = NewlineScanner::Count(text.data(), text.data() + text.size());
+   double countMs = c.GetDiffDouble(Chrono::MS);
+   c.Start();
+   TextualContent doc((TextualContent::FilePath(TEST_FILE_PATH)));
+   double loadMs = c.GetDiffDouble(Chrono::MS);
+   if (doc.chunks.size() != count) throw "bad line count";
+   c.Start();
+   LineInterner interner(doc.chunks.size());
+   std::vector<uint32_t> ids;
+   interner.intern(doc.chunks, ids);
+   double internMs = c.GetDiffDouble(Chrono::MS);
+   double countRate = text.size() / countMs / 1e6, loadRate = text.size() / loadMs / 1e6, internRate = text.size() / internMs / 1e6;
+   printf("File %zu MB, %zu lines: newlines counted at %lg GB/s, mapped and chunked at %lg GB/s, interned at %lg GB/s\n",
+      text.size() >> 20, count, countRate, loadRate, internRate);
+   Benchmark::Record("newlines counted", countRate, "GB/s", false);
+   Benchmark::Record("mapped and chunked", loadRate, "GB/s", false);
+   Benchmark::Record("interned", internRate, "GB/s", false);
+   remove(TEST_FILE_PATH);
 }
 
 int main() {
    //test_sample(text_sample_same);
    //test_sample(text_sample_fulldiff);
    test_sample(text_sample0);
+   test_sample(text_sample1);
+
+   test_reference(text_sample_same);
+   test_reference(text_sample_fulldiff);
+   test_reference(text_sample0);
+   test_reference(text_sample1);
+   test_random(1000);
+   test_flags();
+   test_anchored();
+   test_swapped(200000);
+   test_file();
+
+   Benchmark::Register("large", []() { bench_large(200000, 1000); });
+   Benchmark::Register("file", []() { bench_file(256 << 20); });
+   Benchmark::Run("DiffAlgorithm");
    return 0;
 }
-
@@ -0,0 +1,129 @@
+#ifndef MYERS_DIFF_H_
+#define MYERS_DIFF_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Myers O((N+M)D) diff, "An O(ND) Difference Algorithm and Its Variations",
+// in linear space: the middle snake of the edit graph is found by running
+// the greedy search from both corners until the paths overlap, then each
+// side of it is diffed recursively. equal(i, j) compares the item i of A
+// with the item j of B, the common pairs of a shortest edit script are
+// appended to matches in order.
+template <class TEqual>
+class MyersDiff {
+public:
+   typedef std::vector<std::pair<int, int>> Matches;
+
+   static void Run(int n, int m, const TEqual& equal, Matches& matches) {
+      MyersDiff diff(n, m, equal, matches);
+      diff.diff(0, n, 0, m);
+   }
+
+private:
+   const TEqual& equal;
+   Matches& matches;
+   std::vector<int> forward, backward;   // Furthest x per diagonal, shared by the recursion
+
+   MyersDiff(int n, int m, const TEqual& equal, Matches& matches) : equal(equal), matches(matches) {
+      this->forward.resize(n + m + 4);
+      this->backward.resize(n + m + 4);
+   }
+
+   void diff(int a0, int a1, int b0, int b1) {
+      // Common prefix and suffix need no search
+      while (a0 < a1 && b0 < b1 && this->equal(a0, b0)) {
+         this->matches.push_back(std::make_pair(a0++, b0++));
+      }
+      int suffix = 0;
+      while (a0 < a1 - suffix && b0 < b1 - suffix && this->equal(a1 - suffix - 1, b1 - suffix - 1)) {
+         suffix++;
+      }
+      a1 -= suffix;
+      b1 -= suffix;
+
+      int splitA, splitB;
+      if (a0 < a1 && b0 < b1 && this->middleSnake(a0, a1, b0, b1, splitA, splitB)) {
+         this->diff(a0, splitA, b0, splitB);
+         this->diff(splitA, a1, splitB, b1);
+      }
+      for (int i = 0; i < suffix; i++) {
+         this->matches.push_back(std::make_pair(a1 + i, b1 + i));
+      }
+   }
+
+   // Find where the forward and backward D-paths overlap, the split point is
+   // the end of the forward snake. False when A and B have nothing in common.
+   // Diagonals whose path left the grid are no longer extended.
+   bool middleSnake(int a0, int a1, int b0, int b1, int& splitA, int& splitB) {
+      int n = a1 - a0, m = b1 - b0;
+      int maxD = (n + m + 1) / 2;
+      int offset = maxD, length = 2 * maxD;
+      int* v1 = this->forward.data();
+      int* v2 = this->backward.data();
+      std::fill(v1, v1 + length + 2, -1);
+      std::fill(v2, v2 + length + 2, -1);
+      v1[offset + 1] = 0;
+      v2[offset + 1] = 0;
+
+      int delta = n - m;
+      bool front = (delta & 1) != 0;   // Odd delta: the overlap is seen by the forward pass
+      int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+      for (int d = 0; d < maxD; d++) {
+         for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            int k1Offset = offset + k1;
+            int x1;
+            if (k1 == -d || (k1 != d && v1[k1Offset - 1] < v1[k1Offset + 1])) x1 = v1[k1Offset + 1];
+            else x1 = v1[k1Offset - 1] + 1;
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && this->equal(a0 + x1, b0 + y1)) x1++, y1++;
+            v1[k1Offset] = x1;
+            if (x1 > n) k1end += 2;
+            else if (y1 > m) k1start += 2;
+            else if (front) {
+               int k2Offset = offset + delta - k1;
+               if (k2Offset >= 0 && k2Offset < length && v2[k2Offset] != -1 && x1 >= n - v2[k2Offset]) {
+                  splitA = a0 + x1;
+                  splitB = b0 + y1;
+                  return true;
+               }
+            }
+         }
+
+         // Backward, x2 and y2 count from the ends of A and B
+         for (int k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            int k2Offset = offset + k2;
+            int x2;
+            if (k2 == -d || (k2 != d && v2[k2Offset - 1] < v2[k2Offset + 1])) x2 = v2[k2Offset + 1];
+            else x2 = v2[k2Offset - 1] + 1;
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && this->equal(a1 - x2 - 1, b1 - y2 - 1)) x2++, y2++;
+            v2[k2Offset] = x2;
+            if (x2 > n) k2end += 2;
+            else if (y2 > m) k2start += 2;
+            else if (!front) {
+               int k1Offset = offset + delta - k2;
+               if (k1Offset >= 0 && k1Offset < length && v1[k1Offset] != -1) {
+                  int x1 = v1[k1Offset];
+                  int y1 = offset + x1 - k1Offset;
+                  if (x1 >= n - x2) {
+                     splitA = a0 + x1;
+                     splitB = b0 + y1;
+                     return true;
+                  }
+               }
+            }
+         }
+      }
+      return false;
+   }
+};
+
+// Common pairs of a shortest edit script between n items of A and m items of B
+template <class TEqual>
+void MyersMatches(int n, int m, const TEqual& equal, std::vector<std::pair<int, int>>& matches) {
+   MyersDiff<TEqual>::Run(n, m, equal, matches);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef NEWLINE_SCANNER_H_
+#define NEWLINE_SCANNER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NEWLINE_SCANNER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NEWLINE_SCANNER_SSE2 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Find the '\n' of a buffer 32 (AVX2) or 16 (SSE2) bytes at a time: a
+// compare gives a bit mask of the newlines in the block, then its bits are
+// visited or counted. memchr elsewhere.
+struct NewlineScanner {
+
+   static size_t Count(const char* start, const char* end) {
+      size_t count = 0;
+#if NEWLINE_SCANNER_AVX2 || NEWLINE_SCANNER_SSE2
+      const char* ptr = start;
+      for (; end - ptr >= kBlockSize; ptr += kBlockSize) {
+         count += PopCount(BlockMask(ptr));
+      }
+      for (; ptr < end; ptr++) {
+         if (*ptr == '\n') count++;
+      }
+#else
+      for (const char* ptr = start; (ptr = (const char*)memchr(ptr, '\n', end - ptr)) != 0; ptr++) {
+         count++;
+      }
+#endif
+      return count;
+   }
+
+   // Call visit(ptr) on each newline, in order
+   template <class TVisitor>
+   static void Scan(const char* start, const char* end, const TVisitor& visit) {
+#if NEWLINE_SCANNER_AVX2 || NEWLINE_SCANNER_SSE2
+      const char* ptr = start;
+      for (; end - ptr >= kBlockSize; ptr += kBlockSize) {
+         for (uint32_t mask = BlockMask(ptr); mask; mask &= mask - 1) {
+            visit(ptr + TrailingZeros(mask));
+         }
+      }
+      for (; ptr < end; ptr++) {
+         if (*ptr == '\n') visit(ptr);
+      }
+#else
+      for (const char* ptr = start; (ptr = (const char*)memchr(ptr, '\n', end - ptr)) != 0; ptr++) {
+         visit(ptr);
+      }
+#endif
+   }
+
+private:
+#if NEWLINE_SCANNER_AVX2
+   enum { kBlockSize = 32 };
+   static inline uint32_t BlockMask(const char* ptr) {
+      __m256i block = _mm256_loadu_si256((const __m256i*)ptr);
+      return uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))));
+   }
+#elif NEWLINE_SCANNER_SSE2
+   enum { kBlockSize = 16 };
+   static inline uint32_t BlockMask(const char* ptr) {
+      __m128i block = _mm_loadu_si128((const __m128i*)ptr);
+      return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))));
+   }
+#endif
+
+   static inline int PopCount(uint32_t mask) {
+#if defined(_MSC_VER)
+      mask = mask - ((mask >> 1) & 0x55555555);
+      mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+      return int((((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#else
+      return __builtin_popcount(mask);
+#endif
+   }
+
+   static inline int TrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+      unsigned long index;
+      _BitScanForward(&index, mask);
+      return int(index);
+#else
+      return __builtin_ctz(mask);
+#endif
+   }
+};
+
+#endif
@@ -0,0 +1,236 @@
+#ifndef TEXTUAL_CONTENT_H_
+#define TEXTUAL_CONTENT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "./newline-scanner.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+struct TextualContent {
+
+   // Chunk comparison options
+   enum Flags {
+      IGNORE_WHITESPACE = 1,   // Skip spaces, tabs and carriage returns
+      IGNORE_CASE = 2,         // ASCII letters
+   };
+
+   struct Text {
+      const char* start;
+      const char* end;
+      Text(const char* start, const char* end) : start(start), end(end) {
+      }
+   };
+
+   // Chunks are not hashed when chunked, the LineInterner hashes them
+   // when it gives them ids
+   struct Chunk : Text {
+      int position;
+      Chunk(int position, const char* start, const char* end) : Text(start, end), position(position) {
+      }
+      std::string str() {
+         return std::string(this->start, this->length());
+      }
+      size_t length() {
+         return this->end - this->start;
+      }
+      bool equals(Chunk* other, int flags = 0) {
+         if (flags) return Equals(this->start, this->end, other->start, other->end, flags);
+         if (this->length() != other->length()) return false;
+         return !memcmp(this->start, other->start, this->length());
+      }
+   };
+
+   std::vector<Chunk> chunks;
+   Text content;
+   int flags;
+
+   TextualContent(const char* bytes, int length, int flags = 0) : content(bytes, bytes + length), flags(flags) {
+      this->chunkify();
+   }
+
+   struct FilePath {
+      const char* path;
+      explicit FilePath(const char* path) : path(path) {
+      }
+   };
+
+   // Content of a file, mapped in memory for the life of the object
+   TextualContent(FilePath file, int flags = 0) : content(0, 0), flags(flags) {
+      this->map(file.path);
+      this->chunkify();
+   }
+
+   ~TextualContent() {
+      this->unmap();
+   }
+
+   TextualContent(const TextualContent&) = delete;
+   TextualContent& operator=(const TextualContent&) = delete;
+
+   // One chunk per line, without its "\n" or "\r\n", the last line may have
+   // no newline. The newlines are counted first to allocate the chunks once.
+   void chunkify() {
+      this->chunks.clear();
+      this->chunks.reserve(NewlineScanner::Count(content.start, content.end) + 1);
+      const char* prevPtr = content.start;
+      NewlineScanner::Scan(content.start, content.end, [this, &prevPtr](const char* ptr) {
+         this->pushChunk(prevPtr, ptr);
+         prevPtr = ptr + 1;
+      });
+      if (prevPtr < content.end) {
+         this->pushChunk(prevPtr, content.end);
+      }
+   }
+   void pushChunk(const char* start, const char* end) {
+      if (end > start && end[-1] == '\r') end--;
+      this->chunks.push_back(Chunk(int(this->chunks.size()), start, end));
+   }
+
+   void print() {
+      for (auto& chunk : this->chunks) {
+         printf("> %.*s\n", chunk.end - chunk.start, chunk.start);
+      }
+   }
+
+#if defined(_WIN32)
+   HANDLE file = INVALID_HANDLE_VALUE;
+   HANDLE mapping = 0;
+#else
+   void* mapping = 0;
+   size_t mappingSize = 0;
+#endif
+
+   void map(const char* path) {
+#if defined(_WIN32)
+      this->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+      if (this->file == INVALID_HANDLE_VALUE) throw "cannot open file";
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(this->file, &size)) {
+         this->unmap();
+         throw "cannot read file size";
+      }
+      if (size.QuadPart == 0) return;
+      this->mapping = CreateFileMappingA(this->file, 0, PAGE_READONLY, 0, 0, 0);
+      const char* bytes = this->mapping ? (const char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+      if (!bytes) {
+         this->unmap();
+         throw "cannot map file";
+      }
+      this->content = Text(bytes, bytes + size.QuadPart);
+#else
+      int fd = open(path, O_RDONLY);
+      if (fd < 0) throw "cannot open file";
+      struct stat info;
+      if (fstat(fd, &info) < 0) {
+         close(fd);
+         throw "cannot read file size";
+      }
+      if (info.st_size > 0) {
+         this->mapping = mmap(0, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+         if (this->mapping == MAP_FAILED) {
+            this->mapping = 0;
+            close(fd);
+            throw "cannot map file";
+         }
+         this->mappingSize = size_t(info.st_size);
+         madvise(this->mapping, this->mappingSize, MADV_SEQUENTIAL);
+         this->content = Text((const char*)this->mapping, (const char*)this->mapping + this->mappingSize);
+      }
+      close(fd);
+#endif
+   }
+
+   void unmap() {
+#if defined(_WIN32)
+      if (this->mapping && this->content.start) UnmapViewOfFile(this->content.start);
+      if (this->mapping) CloseHandle(this->mapping);
+      if (this->file != INVALID_HANDLE_VALUE) CloseHandle(this->file);
+#else
+      if (this->mapping) munmap(this->mapping, this->mappingSize);
+#endif
+   }
+
+   static inline bool IsSpace(char c) {
+      return c == ' ' || c == '\t' || c == '\r';
+   }
+   static inline char Fold(char c, int flags) {
+      return (flags & IGNORE_CASE) && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+   }
+
+   // 64-bit hash of a chunk, mixing 8 bytes at a time. With flags the bytes
+   // are normalized first, so equal chunks under the flags hash the same.
+   static uint64_t Hash(const char* start, const char* end, int flags = 0) {
+      uint64_t hash = 0x243F6A8885A308D3ull;
+      uint64_t length = 0;
+      if (!flags) {
+         length = end - start;
+         for (; end - start >= 8; start += 8) {
+            uint64_t word;
+            memcpy(&word, start, 8);
+            hash = MixHash(hash, word);
+         }
+         if (start < end) {
+            uint64_t word = 0;
+            memcpy(&word, start, end - start);
+            hash = MixHash(hash, word);
+         }
+      }
+      else {
+         uint64_t word = 0;
+         int shift = 0;
+         for (; start < end; start++) {
+            if ((flags & IGNORE_WHITESPACE) && IsSpace(*start)) continue;
+            word |= uint64_t(uint8_t(Fold(*start, flags))) << shift;
+            length++;
+            if ((shift += 8) == 64) {
+               hash = MixHash(hash, word);
+               word = 0;
+               shift = 0;
+            }
+         }
+         if (shift) hash = MixHash(hash, word);
+      }
+      // Final avalanche of MurmurHash3
+      hash ^= length;
+      hash ^= hash >> 33;
+      hash *= 0xFF51AFD7ED558CCDull;
+      hash ^= hash >> 33;
+      hash *= 0xC4CEB9FE1A85EC53ull;
+      hash ^= hash >> 33;
+      return hash;
+   }
+
+   static inline uint64_t MixHash(uint64_t hash, uint64_t word) {
+      word *= 0x87C37B91114253D5ull;
+      word = (word << 31) | (word >> 33);
+      word *= 0x4CF5AD432745937Full;
+      hash ^= word;
+      hash = (hash << 27) | (hash >> 37);
+      return hash * 5 + 0x52DCE729;
+   }
+
+   // Chunk equality under the flags
+   static bool Equals(const char* startA, const char* endA, const char* startB, const char* endB, int flags) {
+      for (;;) {
+         if (flags & IGNORE_WHITESPACE) {
+            while (startA < endA && IsSpace(*startA)) startA++;
+            while (startB < endB && IsSpace(*startB)) startB++;
+         }
+         if (startA == endA || startB == endB) return startA == endA && startB == endB;
+         if (Fold(*startA++, flags) != Fold(*startB++, flags)) return false;
+      }
+   }
+};
+
+#endif
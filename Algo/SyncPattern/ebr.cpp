@@ -0,0 +1,156 @@
+
+#include "ebr.h"
+#include "spinlock.h"
+
+// NOTE on the epochs:
+//
+// An object retired while the global epoch is e may still be reached by the
+// readers of epoch e, and of e - 1 that have not yet observed e. The epoch
+// only moves to e + 1 once every thread in a critical section has observed e,
+// so at e + 2 no reader can hold it anymore and it is freed.
+
+static const uint64_t kQuiescent = UINT64_MAX;   // Record epoch outside critical sections
+
+struct RetiredObject {
+   void* p;
+   EpochReclaimer::Deleter deleter;
+   uint64_t epoch;
+};
+
+// Registry of the per-thread epochs: an append-only list, the records
+// of the exited threads are reused
+struct EpochRecord {
+   std::atomic<uint64_t> epoch;
+   std::atomic<bool> inUse;
+   EpochRecord* next;
+   char padding[64];   // Written at each Enter/Exit, alone on its cache line
+};
+
+static std::atomic<uint64_t> global_epoch(0);
+static std::atomic<EpochRecord*> epoch_records(0);
+static std::atomic<size_t> pending_count(0);
+
+// Retired objects of the exited threads
+struct OrphanList {
+   SpinLock guard;
+   std::vector<RetiredObject> objects;
+};
+
+static OrphanList& Orphans() {
+   static OrphanList* orphans = new OrphanList();   // Never destroyed: threads may exit after main
+   return *orphans;
+}
+
+static EpochRecord* AcquireRecord() {
+   for (EpochRecord* record = epoch_records.load(); record; record = record->next) {
+      bool used = false;
+      if (!record->inUse.load() && record->inUse.compare_exchange_strong(used, true)) {
+         return record;
+      }
+   }
+   EpochRecord* record = new EpochRecord();
+   record->epoch.store(kQuiescent);
+   record->inUse.store(true);
+   record->next = epoch_records.load();
+   while (!epoch_records.compare_exchange_weak(record->next, record)) {
+   }
+   return record;
+}
+
+// Free the objects retired 2 epochs before epoch, keep the others
+static void FreeRetired(std::vector<RetiredObject>& retired, uint64_t epoch) {
+   size_t kept = 0;
+   for (size_t i = 0; i < retired.size(); i++) {
+      if (retired[i].epoch + 2 <= epoch) {
+         retired[i].deleter(retired[i].p);
+         pending_count.fetch_sub(1, std::memory_order_relaxed);
+      }
+      else {
+         retired[kept++] = retired[i];
+      }
+   }
+   retired.resize(kept);
+}
+
+// Move the global epoch forward when all the active threads observed it,
+// return the global epoch
+static uint64_t TryAdvance() {
+   uint64_t epoch = global_epoch.load();
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   for (EpochRecord* record = epoch_records.load(); record; record = record->next) {
+      uint64_t local = record->epoch.load();
+      if (local != kQuiescent && local != epoch) return epoch;
+   }
+   global_epoch.compare_exchange_strong(epoch, epoch + 1);
+   return global_epoch.load();
+}
+
+struct ThreadEpoch {
+   EpochRecord* record;
+   int depth;
+   std::vector<RetiredObject> retired;
+
+   ThreadEpoch() : record(AcquireRecord()), depth(0) {
+   }
+   ~ThreadEpoch() {
+      FreeRetired(retired, TryAdvance());
+      if (!retired.empty()) {
+         OrphanList& orphans = Orphans();
+         SpinLockHolder holder(&orphans.guard);
+         orphans.objects.insert(orphans.objects.end(), retired.begin(), retired.end());
+      }
+      record->epoch.store(kQuiescent);
+      record->inUse.store(false);
+   }
+};
+
+static ThreadEpoch& LocalEpoch() {
+   static thread_local ThreadEpoch local;
+   return local;
+}
+
+void EpochReclaimer::Enter() {
+   ThreadEpoch& local = LocalEpoch();
+   if (local.depth++ == 0) {
+      // Publish before any read of the protected structure
+      local.record->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+   }
+}
+
+void EpochReclaimer::Exit() {
+   ThreadEpoch& local = LocalEpoch();
+   if (--local.depth == 0) {
+      local.record->epoch.store(kQuiescent, std::memory_order_release);
+   }
+}
+
+void EpochReclaimer::Retire(void* p, Deleter deleter) {
+   ThreadEpoch& local = LocalEpoch();
+   RetiredObject object = { p, deleter, global_epoch.load() };
+   local.retired.push_back(object);
+   pending_count.fetch_add(1, std::memory_order_relaxed);
+   if (local.retired.size() % kBatchSize == 0) {
+      Collect();
+   }
+}
+
+void EpochReclaimer::Collect() {
+   ThreadEpoch& local = LocalEpoch();
+   uint64_t epoch = TryAdvance();
+   FreeRetired(local.retired, epoch);
+
+   OrphanList& orphans = Orphans();
+   if (orphans.guard.tryLock()) {
+      FreeRetired(orphans.objects, epoch);
+      orphans.guard.unlock();
+   }
+}
+
+size_t EpochReclaimer::PendingCount() {
+   return pending_count.load(std::memory_order_relaxed);
+}
+
+uint64_t EpochReclaimer::CurrentEpoch() {
+   return global_epoch.load();
+}
@@ -0,0 +1,57 @@
+#ifndef BASE_EBR_H_
+#define BASE_EBR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// Epoch-based memory reclamation for lock-free structures.
+// Readers enter a critical section with an EpochGuard, which only publishes
+// the global epoch in a per-thread slot. Removed objects are retired to a
+// per-thread list tagged with the current epoch, and freed by batches once
+// the global epoch moved twice: then no reader can still see them.
+// The global epoch moves when all the threads inside a critical section
+// have observed it.
+class EpochReclaimer {
+public:
+   typedef void (*Deleter)(void*);
+
+   // Critical section, nests
+   class Guard {
+   public:
+      Guard() {
+         EpochReclaimer::Enter();
+      }
+      ~Guard() {
+         EpochReclaimer::Exit();
+      }
+   };
+
+   static void Enter();
+   static void Exit();
+
+   // Free p with deleter once no reader can access it anymore
+   static void Retire(void* p, Deleter deleter);
+
+   template <class T>
+   static void Retire(T* p) {
+      Retire(p, [](void* q) { delete (T*)q; });
+   }
+
+   // Try to advance the epoch and free what became safe,
+   // automatic every kBatchSize retired objects of a thread
+   static void Collect();
+
+   // Objects retired and not freed yet, over all threads
+   static size_t PendingCount();
+   static uint64_t CurrentEpoch();
+
+   enum {
+      kBatchSize = 64
+   };
+};
+
+typedef EpochReclaimer::Guard EpochGuard;
+
+#endif  // BASE_EBR_H_
@@ -0,0 +1,132 @@
+
+#include "lockbench.h"
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+/*******************************************************
+**** LatencyHistogram
+*******************************************************/
+LatencyHistogram::LatencyHistogram() {
+   this->clear();
+}
+
+void LatencyHistogram::clear() {
+   memset(this->counts, 0, sizeof(this->counts));
+   this->total = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+   for (int i = 0; i < kBuckets; i++) this->counts[i] += other.counts[i];
+   this->total += other.total;
+}
+
+// Values under kSubBuckets have their own bucket, then each power of 2
+// is split in kSubBuckets linear buckets
+int LatencyHistogram::BucketOf(uint64_t ns) {
+   if (ns < kSubBuckets) return int(ns);
+   int exponent = 63;
+   while (!(ns >> exponent)) exponent--;
+   int sub = int(ns >> (exponent - kSubBits)) & (kSubBuckets - 1);
+   return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::BucketLimit(int bucket) {
+   if (bucket < kSubBuckets) return uint64_t(bucket);
+   int exponent = bucket / kSubBuckets + kSubBits - 1;
+   uint64_t sub = uint64_t(bucket % kSubBuckets);
+   return ((kSubBuckets + sub + 1) << (exponent - kSubBits)) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+   if (!this->total) return 0;
+   uint64_t rank = uint64_t(q * double(this->total - 1));
+   uint64_t count = 0;
+   for (int i = 0; i < kBuckets; i++) {
+      count += this->counts[i];
+      if (count > rank) return BucketLimit(i);
+   }
+   return BucketLimit(kBuckets - 1);
+}
+
+/*******************************************************
+**** LockBench
+*******************************************************/
+LockBench::Result LockBench::Summarize(const std::vector<ThreadState>& states, uint64_t elapsedNs) {
+   Result result;
+   LatencyHistogram latency;
+   double sum = 0, sumSquares = 0;
+   result.operations = 0;
+   for (const ThreadState& state : states) {
+      latency.merge(state.latency);
+      result.operations += state.operations;
+      sum += double(state.operations);
+      sumSquares += double(state.operations) * double(state.operations);
+   }
+   result.opsPerSec = double(result.operations) * 1e9 / double(elapsedNs);
+   result.p50 = latency.percentile(0.5);
+   result.p99 = latency.percentile(0.99);
+   result.p999 = latency.percentile(0.999);
+
+   double fair = sum / double(states.size());
+   result.minShare = result.maxShare = 0;
+   if (fair > 0) {
+      result.minShare = 1e300;
+      for (const ThreadState& state : states) {
+         double share = double(state.operations) / fair;
+         if (share < result.minShare) result.minShare = share;
+         if (share > result.maxShare) result.maxShare = share;
+      }
+   }
+   result.jainIndex = sumSquares > 0 ? sum * sum / (double(states.size()) * sumSquares) : 0;
+   return result;
+}
+
+void LockBench::Print(const char* title, const Config& config, const Result& result) {
+   printf("%-20s x%-3d cs=%-4d think=%-4d %10.3lf Mops/s  p50=%llu p99=%llu p999=%llu ns  share=[%.2lf, %.2lf] jain=%.3lf\n",
+      title, config.threads, config.criticalWork, config.thinkWork,
+      result.opsPerSec / 1e6,
+      (unsigned long long)result.p50, (unsigned long long)result.p99, (unsigned long long)result.p999,
+      result.minShare, result.maxShare, result.jainIndex);
+}
+
+uint64_t LockBench::Now() {
+   return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void LockBench::Work(int units) {
+   // A dependent multiply-add chain the compiler can't remove, a few cycles per unit
+   static std::atomic<uint32_t> sink(0);
+   uint32_t value = uint32_t(units);
+   for (int i = 0; i < units; i++) {
+      value = value * 1664525u + 1013904223u;
+   }
+   if (value == 0) sink.store(value, std::memory_order_relaxed);
+}
+
+/*******************************************************
+**** Thread pinning
+*******************************************************/
+#if defined(_WIN32)
+#include <windows.h>
+void LockBench::PinThread(int index) {
+   int cpus = int(std::thread::hardware_concurrency());
+   if (cpus <= 0 || cpus > 64) return;
+   SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (index % cpus));
+}
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+void LockBench::PinThread(int index) {
+   int cpus = int(std::thread::hardware_concurrency());
+   if (cpus <= 0) return;
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(index % cpus, &set);
+   pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+#else
+void LockBench::PinThread(int index) {
+}
+#endif
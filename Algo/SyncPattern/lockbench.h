@@ -0,0 +1,124 @@
+#ifndef BASE_LOCKBENCH_H_
+#define BASE_LOCKBENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "spinlock.h"
+
+// Latency histogram with 16 linear sub-buckets per power of 2 of ns,
+// percentiles are accurate to about 6%
+class LatencyHistogram {
+public:
+   enum {
+      kSubBits = 4,
+      kSubBuckets = 1 << kSubBits,
+      kBuckets = (64 - kSubBits + 1) * kSubBuckets
+   };
+
+   LatencyHistogram();
+   void clear();
+   inline void record(uint64_t ns) {
+      this->counts[BucketOf(ns)]++;
+      this->total++;
+   }
+   void merge(const LatencyHistogram& other);
+   uint64_t count() const {
+      return this->total;
+   }
+   // Upper bound in ns of the latency at percentile q in [0, 1]
+   uint64_t percentile(double q) const;
+
+private:
+   uint64_t counts[kBuckets];
+   uint64_t total;
+
+   static int BucketOf(uint64_t ns);
+   static uint64_t BucketLimit(int bucket);
+};
+
+// Contention benchmark of a lock: threads loop on lock, critical section,
+// unlock, think time, for a given duration. Reports the throughput, the
+// acquisition latency percentiles and the share of operations per thread.
+class LockBench {
+public:
+   struct Config {
+      int threads;
+      int criticalWork;   // Work units inside the lock, see Work()
+      int thinkWork;      // Work units between two locks
+      int durationMs;
+      bool pin;           // Pin thread i on cpu i % cpu count
+      Config(int threads = 1, int criticalWork = 10, int thinkWork = 100, int durationMs = 200, bool pin = true)
+         : threads(threads), criticalWork(criticalWork), thinkWork(thinkWork), durationMs(durationMs), pin(pin) {
+      }
+   };
+
+   struct Result {
+      uint64_t operations;
+      double opsPerSec;
+      uint64_t p50, p99, p999;   // Acquisition latency in ns
+      double minShare, maxShare; // Per-thread share of the operations, 1 is the fair share
+      double jainIndex;          // Jain's fairness index, 1 when all threads got the same share
+   };
+
+   // Run the benchmark on any lock with the SpinLock lock/unlock API
+   template <class TLock>
+   static Result Run(TLock& guard, const Config& config) {
+      std::vector<ThreadState> states(config.threads);
+      std::atomic<int> ready(0);
+      std::atomic<bool> go(false), stop(false);
+      volatile uint64_t shared = 0;
+
+      std::vector<std::thread> workers;
+      for (int t = 0; t < config.threads; t++) {
+         workers.push_back(std::thread([&, t]() {
+            ThreadState& state = states[t];
+            if (config.pin) PinThread(t);
+            ready++;
+            while (!go.load()) SpinlockPause();
+            uint64_t operations = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+               uint64_t start = Now();
+               guard.lock();
+               uint64_t acquired = Now();
+               shared = shared + 1;
+               Work(config.criticalWork);
+               guard.unlock();
+               state.latency.record(acquired - start);
+               operations++;
+               Work(config.thinkWork);
+            }
+            state.operations = operations;
+         }));
+      }
+      while (ready.load() != config.threads) std::this_thread::yield();
+      uint64_t start = Now();
+      go = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(config.durationMs));
+      stop = true;
+      for (auto& worker : workers) worker.join();
+      return Summarize(states, Now() - start);
+   }
+
+   static void Print(const char* title, const Config& config, const Result& result);
+
+   // Portable helpers
+   static uint64_t Now();   // ns
+   static void PinThread(int index);
+   static void Work(int units);
+
+private:
+   struct ThreadState {
+      LatencyHistogram latency;
+      uint64_t operations;
+      char padding[64];   // No false sharing with the next thread state
+      ThreadState() : operations(0) {}
+   };
+
+   static Result Summarize(const std::vector<ThreadState>& states, uint64_t elapsedNs);
+};
+
+#endif  // BASE_LOCKBENCH_H_
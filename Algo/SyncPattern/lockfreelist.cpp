@@ -0,0 +1,106 @@
+
+#include "lockfreelist.h"
+
+LockFreeList::LockFreeList() : head_(0) {
+}
+
+LockFreeList::~LockFreeList() {
+   Node* node = ToNode(head_.load());
+   while (node) {
+      Node* next = ToNode(node->next.load());
+      delete node;
+      node = next;
+   }
+}
+
+bool LockFreeList::find(uint64_t key, std::atomic<uintptr_t>*& prev, Node*& curr) {
+retry:
+   prev = &head_;
+   curr = ToNode(prev->load(std::memory_order_acquire));
+   while (curr) {
+      uintptr_t next = curr->next.load(std::memory_order_acquire);
+      if (IsMarked(next)) {
+         // curr is removed: unlink it, retire it when we did
+         uintptr_t expected = uintptr_t(curr);
+         if (!prev->compare_exchange_strong(expected, next & ~uintptr_t(1), std::memory_order_acq_rel)) {
+            goto retry;
+         }
+         EpochReclaimer::Retire(curr);
+         curr = ToNode(next);
+         continue;
+      }
+      if (curr->key >= key) {
+         return curr->key == key;
+      }
+      prev = &curr->next;
+      curr = ToNode(next);
+   }
+   return false;
+}
+
+bool LockFreeList::insert(uint64_t key) {
+   EpochGuard guard;
+   Node* node = 0;
+   for (;;) {
+      std::atomic<uintptr_t>* prev;
+      Node* curr;
+      if (this->find(key, prev, curr)) {
+         delete node;
+         return false;
+      }
+      if (!node) {
+         node = new Node();
+         node->key = key;
+      }
+      node->next.store(uintptr_t(curr), std::memory_order_relaxed);
+      uintptr_t expected = uintptr_t(curr);
+      if (prev->compare_exchange_strong(expected, uintptr_t(node), std::memory_order_release)) {
+         return true;
+      }
+   }
+}
+
+bool LockFreeList::remove(uint64_t key) {
+   EpochGuard guard;
+   for (;;) {
+      std::atomic<uintptr_t>* prev;
+      Node* curr;
+      if (!this->find(key, prev, curr)) return false;
+
+      // Logical removal: mark the next link, the winner owns the removal
+      uintptr_t next = curr->next.load(std::memory_order_acquire);
+      if (IsMarked(next)) continue;
+      if (!curr->next.compare_exchange_strong(next, next | 1, std::memory_order_acq_rel)) continue;
+
+      // Physical removal, else a later find unlinks it
+      uintptr_t expected = uintptr_t(curr);
+      if (prev->compare_exchange_strong(expected, next, std::memory_order_acq_rel)) {
+         EpochReclaimer::Retire(curr);
+      }
+      else {
+         this->find(key, prev, curr);
+      }
+      return true;
+   }
+}
+
+bool LockFreeList::contains(uint64_t key) {
+   EpochGuard guard;
+   // Wait-free walk, the removed nodes are skipped without unlinking them
+   Node* curr = ToNode(head_.load(std::memory_order_acquire));
+   while (curr && curr->key < key) {
+      curr = ToNode(curr->next.load(std::memory_order_acquire));
+   }
+   return curr && curr->key == key && !IsMarked(curr->next.load(std::memory_order_acquire));
+}
+
+size_t LockFreeList::size() {
+   EpochGuard guard;
+   size_t count = 0;
+   for (Node* curr = ToNode(head_.load()); curr; ) {
+      uintptr_t next = curr->next.load(std::memory_order_acquire);
+      if (!IsMarked(next)) count++;
+      curr = ToNode(next);
+   }
+   return count;
+}
@@ -0,0 +1,44 @@
+#ifndef BASE_LOCKFREELIST_H_
+#define BASE_LOCKFREELIST_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "ebr.h"
+
+// Lock-free sorted set of keys, Harris-Michael linked list: a node is
+// removed by marking the low bit of its next pointer, then unlinked by any
+// thread that walks over it. The thread that unlinks a node retires it
+// to the EpochReclaimer, the operations run inside an EpochGuard so that
+// the nodes they walk on are not freed under them.
+class LockFreeList {
+public:
+   LockFreeList();
+   ~LockFreeList();   // Not concurrent with the other operations
+
+   bool insert(uint64_t key);   // False when already present
+   bool remove(uint64_t key);   // False when absent
+   bool contains(uint64_t key);
+
+   size_t size();   // Walk the list, approximate when concurrently modified
+
+private:
+   struct Node {
+      uint64_t key;
+      std::atomic<uintptr_t> next;   // Next node | 1 when this node is removed
+   };
+
+   std::atomic<uintptr_t> head_;
+
+   static inline Node* ToNode(uintptr_t link) {
+      return (Node*)(link & ~uintptr_t(1));
+   }
+   static inline bool IsMarked(uintptr_t link) {
+      return (link & 1) != 0;
+   }
+
+   // Find the first node with key >= key, unlinking the removed nodes on the way.
+   // prev is the link that pointed to curr.
+   bool find(uint64_t key, std::atomic<uintptr_t>*& prev, Node*& curr);
+};
+
+#endif  // BASE_LOCKFREELIST_H_
@@ -0,0 +1,212 @@
+
+#include "spinlock.h"
+#include "lockprofile.h"
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+// NOTE on the per-thread stats:
+//
+// A thread owns a table of stats chunks indexed by lock id, it is the only
+// writer of its counters so they are updated with relaxed load + store.
+// Dump() reads the tables of the live threads under the registry mutex,
+// an exiting thread adds its counters to the retired stats under the same mutex.
+
+static const uint32_t kChunkSize = 256;
+static const uint32_t kMaxChunks = 1024;   // Profile the first 256K ids
+static const uint32_t kMaxIds = kChunkSize * kMaxChunks;
+static const uint32_t kDroppedId = kMaxIds;  // Past the tables, its lock is not profiled
+
+struct AtomicStats {
+   std::atomic<uint64_t> acquisitions;
+   std::atomic<uint64_t> contended;
+   std::atomic<uint64_t> slowNs;
+   std::atomic<uint64_t> holds[LockProfiler::kHoldBuckets];
+};
+
+inline static void Increment(std::atomic<uint64_t>& counter, uint64_t value) {
+   counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct ThreadLockProfile;
+
+struct LockProfileRegistry {
+   std::mutex guard;
+   std::vector<std::string> names;
+   std::unordered_map<const char*, uint32_t> sites;   // Id of the named locks, by name pointer
+   std::vector<ThreadLockProfile*> threads;
+   std::vector<LockProfiler::Stats> retired;
+   std::atomic<uint32_t> nextId;
+   uint64_t dropped;   // Unnamed locks registered past kMaxIds
+   LockProfileRegistry() : nextId(0), dropped(0) {}
+};
+
+static LockProfileRegistry& Registry() {
+   static LockProfileRegistry* registry = new LockProfileRegistry();   // Never destroyed: threads may exit after main
+   return *registry;
+}
+
+struct ThreadLockProfile {
+   std::atomic<AtomicStats*> chunks[kMaxChunks];
+
+   ThreadLockProfile() {
+      for (uint32_t i = 0; i < kMaxChunks; i++) chunks[i].store(0, std::memory_order_relaxed);
+      LockProfileRegistry& registry = Registry();
+      std::lock_guard<std::mutex> holder(registry.guard);
+      registry.threads.push_back(this);
+   }
+   ~ThreadLockProfile() {
+      LockProfileRegistry& registry = Registry();
+      std::lock_guard<std::mutex> holder(registry.guard);
+      registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), this));
+      for (uint32_t c = 0; c < kMaxChunks; c++) {
+         AtomicStats* chunk = chunks[c].load(std::memory_order_relaxed);
+         if (!chunk) continue;
+         for (uint32_t i = 0; i < kChunkSize; i++) {
+            uint32_t id = c * kChunkSize + i;
+            if (id >= registry.retired.size()) registry.retired.resize(id + 1);
+            this->addTo(id, registry.retired[id]);
+         }
+         delete[] chunk;
+      }
+   }
+   AtomicStats* get(uint32_t id) {
+      uint32_t c = id / kChunkSize;
+      if (c >= kMaxChunks) return 0;
+      AtomicStats* chunk = chunks[c].load(std::memory_order_relaxed);
+      if (!chunk) {
+         chunk = new AtomicStats[kChunkSize];
+         memset((void*)chunk, 0, sizeof(AtomicStats) * kChunkSize);
+         chunks[c].store(chunk, std::memory_order_release);
+      }
+      return &chunk[id % kChunkSize];
+   }
+   void addTo(uint32_t id, LockProfiler::Stats& stats) {
+      uint32_t c = id / kChunkSize;
+      if (c >= kMaxChunks) return;
+      AtomicStats* chunk = chunks[c].load(std::memory_order_acquire);
+      if (!chunk) return;
+      AtomicStats& local = chunk[id % kChunkSize];
+      stats.acquisitions += local.acquisitions.load(std::memory_order_relaxed);
+      stats.contended += local.contended.load(std::memory_order_relaxed);
+      stats.slowNs += local.slowNs.load(std::memory_order_relaxed);
+      for (int i = 0; i < LockProfiler::kHoldBuckets; i++) {
+         stats.holds[i] += local.holds[i].load(std::memory_order_relaxed);
+      }
+   }
+};
+
+static ThreadLockProfile& ThreadProfile() {
+   static thread_local ThreadLockProfile profile;
+   return profile;
+}
+
+uint32_t LockProfiler::Register(const char* name) {
+   LockProfileRegistry& registry = Registry();
+   std::lock_guard<std::mutex> holder(registry.guard);
+   if (name) {
+      auto found = registry.sites.find(name);
+      if (found != registry.sites.end()) return found->second;
+   }
+   if (registry.names.size() >= kMaxIds) {
+      registry.dropped++;
+      return kDroppedId;
+   }
+   uint32_t id = registry.nextId++;
+   if (name) {
+      registry.names.push_back(name);
+      registry.sites[name] = id;
+   }
+   else registry.names.push_back("lock#" + std::to_string(id));
+   return id;
+}
+
+void LockProfiler::OnAcquire(uint32_t id, bool contended, uint64_t slowNs) {
+   AtomicStats* stats = ThreadProfile().get(id);
+   if (!stats) return;
+   Increment(stats->acquisitions, 1);
+   if (contended) {
+      Increment(stats->contended, 1);
+      Increment(stats->slowNs, slowNs);
+   }
+}
+
+void LockProfiler::OnRelease(uint32_t id, uint64_t holdNs) {
+   AtomicStats* stats = ThreadProfile().get(id);
+   if (!stats) return;
+   int bucket = 0;
+   while (bucket < kHoldBuckets - 1 && (uint64_t(1) << bucket) <= holdNs) bucket++;
+   Increment(stats->holds[bucket], 1);
+}
+
+uint64_t LockProfiler::Now() {
+   return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+bool LockProfiler::GetStats(uint32_t id, Stats& stats) {
+   LockProfileRegistry& registry = Registry();
+   std::lock_guard<std::mutex> holder(registry.guard);
+   if (id >= registry.names.size()) return false;
+   memset(&stats, 0, sizeof(stats));
+   if (id < registry.retired.size()) stats = registry.retired[id];
+   for (ThreadLockProfile* thread : registry.threads) {
+      thread->addTo(id, stats);
+   }
+   return true;
+}
+
+#ifdef SPINLOCK_PROFILE
+// Upper bound in ns of the hold time at percentile q of the histogram
+static uint64_t HoldPercentile(const LockProfiler::Stats& stats, double q) {
+   uint64_t total = 0;
+   for (int i = 0; i < LockProfiler::kHoldBuckets; i++) total += stats.holds[i];
+   uint64_t rank = uint64_t(q * double(total)), count = 0;
+   for (int i = 0; i < LockProfiler::kHoldBuckets; i++) {
+      count += stats.holds[i];
+      if (count > rank) return uint64_t(1) << i;
+   }
+   return 0;
+}
+#endif
+
+void LockProfiler::Dump(FILE* out, size_t topN) {
+#ifndef SPINLOCK_PROFILE
+   (void)topN;
+   fprintf(out, "lock profiling disabled, define SPINLOCK_PROFILE in spinlock.h\n");
+#else
+   uint32_t count = Registry().nextId.load();
+   std::vector<std::pair<uint32_t, Stats>> locks;
+   for (uint32_t id = 0; id < count; id++) {
+      Stats stats;
+      if (GetStats(id, stats) && stats.acquisitions) locks.push_back(std::make_pair(id, stats));
+   }
+   std::sort(locks.begin(), locks.end(), [](const std::pair<uint32_t, Stats>& a, const std::pair<uint32_t, Stats>& b) {
+      if (a.second.contended != b.second.contended) return a.second.contended > b.second.contended;
+      return a.second.slowNs > b.second.slowNs;
+   });
+   if (locks.size() > topN) locks.resize(topN);
+
+   std::lock_guard<std::mutex> holder(Registry().guard);
+   fprintf(out, "%-40s %12s %12s %8s %12s %10s %10s\n", "lock", "acquired", "contended", "rate", "slow ms", "hold p50", "hold p99");
+   for (auto& lock : locks) {
+      const Stats& stats = lock.second;
+      fprintf(out, "%-40s %12llu %12llu %7.2f%% %12.3f %8llu ns %8llu ns\n",
+         Registry().names[lock.first].c_str(),
+         (unsigned long long)stats.acquisitions,
+         (unsigned long long)stats.contended,
+         100.0 * double(stats.contended) / double(stats.acquisitions),
+         double(stats.slowNs) / 1000000.0,
+         (unsigned long long)HoldPercentile(stats, 0.5),
+         (unsigned long long)HoldPercentile(stats, 0.99));
+   }
+   if (Registry().dropped) {
+      fprintf(out, "%llu unnamed locks not profiled, past the first %u ids: name them by construction site\n",
+         (unsigned long long)Registry().dropped, kMaxIds);
+   }
+#endif
+}
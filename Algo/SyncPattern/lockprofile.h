@@ -0,0 +1,51 @@
+#ifndef BASE_LOCKPROFILE_H_
+#define BASE_LOCKPROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+// Contention profiling of the SpinLock, enabled by SPINLOCK_PROFILE in spinlock.h:
+// each lock gets an id and a label at construction, shared by the locks of
+// the same name such as a SPINLOCK_CALL_SITE, so that the locks created
+// and destroyed again and again don't grow the registry; the lock operations
+// count into per-thread stats without any shared write, Dump() sums the
+// stats of the live and exited threads and prints the most contended locks.
+
+// Label of a lock by its construction site
+#define SPINLOCK_STRINGIFY_(x) #x
+#define SPINLOCK_STRINGIFY(x) SPINLOCK_STRINGIFY_(x)
+#define SPINLOCK_CALL_SITE __FILE__ ":" SPINLOCK_STRINGIFY(__LINE__)
+
+class LockProfiler {
+public:
+   enum {
+      kHoldBuckets = 32   // Hold time histogram: bucket i counts holds under 2^i ns
+   };
+
+   struct Stats {
+      uint64_t acquisitions;
+      uint64_t contended;   // Acquisitions through slowLock
+      uint64_t slowNs;      // Time spent in slowLock
+      uint64_t holds[kHoldBuckets];
+   };
+
+   // Return the id of a new lock. The locks of a name share its id, the name
+   // is a string that outlives the profiler, compared by pointer. Unnamed
+   // locks each get an id, past 256K ids they are counted but not profiled.
+   static uint32_t Register(const char* name);
+
+   static void OnAcquire(uint32_t id, bool contended, uint64_t slowNs);
+   static void OnRelease(uint32_t id, uint64_t holdNs);
+
+   // Timestamp in ns of the profiling clock
+   static uint64_t Now();
+
+   // Aggregate the stats of the lock over all threads
+   static bool GetStats(uint32_t id, Stats& stats);
+
+   // Print the topN locks with the most contended acquisitions
+   static void Dump(FILE* out = stdout, size_t topN = 10);
+};
+
+#endif  // BASE_LOCKPROFILE_H_
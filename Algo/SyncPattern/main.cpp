@@ -1,7 +1,23 @@
 #include <mutex>
+#include <thread>
+#include <vector>
 #include <Windows.h>
 #include "spinlock.h"
+#include "task.h"
+#include "mcslock.h"
+#include "rwspinlock.h"
+#include "seqlock.h"
+#include "lockbench.h"
+#include "stripedlock.h"
+#include "threadpool.h"
+#include "ringqueue.h"
+#include "lockfreelist.h"
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
+#include <unordered_map>
 #include "chrono.h"
+#include "benchmark.h"
 
 struct critical_section {
    CRITICAL_SECTION CriticalSection;
@@ -19,11 +35,6 @@ struct critical_section {
    }
 };
 
-class Task {
-public:
-   virtual void execute() = 0;
-};
-
 class ReadThreadIdTask : public Task {
 public:
    int tid;
@@ -34,6 +45,10 @@ public:
 
 static int x = 0;
 
+// Results of the threads of a measure, each adds its own once after its
+// loop, so that the loop isn't optimized out and the threads don't share a line
+static std::atomic<int> sink(0);
+
 class MutexTask : public Task {
 public:
    std::mutex guard;
@@ -60,17 +75,526 @@ Task* CriticalSection_task = new CriticalSectionTask();
 
 __declspec(noinline) void measureTask(const char* title, Task* task) {
    Chrono c;
-   int count = 1000000;
+   c.PerfTest(title, [task]() { task->execute(); });
+}
+
+// Threads contending on one lock around a short critical section:
+// throughput of the whole group and mean latency of one lock/unlock
+template <class TLock>
+__declspec(noinline) void measureContention(const char* title, TLock& guard, int threads) {
+   int count = 200000;
+   std::vector<std::thread> workers;
+   Chrono c;
+   c.Start();
+   for (int t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&guard, count]() {
+         for (int i = 0; i < count; i++) {
+            guard.lock();
+            x++;
+            guard.unlock();
+         }
+      }));
+   }
+   for (auto& worker : workers) worker.join();
+   double ns = c.GetDiffDouble(Chrono::NS);
+   double ops = double(count) * threads;
+   printf("%s x%d = %lg Mops/s, %lg ns/lock\n", title, threads, ops * 1000.0 / ns, ns * threads / ops);
+   char name[128];
+   snprintf(name, sizeof(name), "%s x%d", title, threads);
+   Benchmark::Record(name, ops * 1000.0 / ns, "Mops/s", false);
+}
+
+void measureContentionModes() {
+   const int threads[] = { 2, 4, 8, 16 };
+   for (int n : threads) {
+      SpinLock spinlock("SpinLock adaptive/sleep");
+      measureContention("SpinLock adaptive", spinlock, n);
+      bool spin = SpinLock::SetAdaptiveSpin(false);
+      measureContention("SpinLock sleep", spinlock, n);
+      SpinLock::SetAdaptiveSpin(spin);
+      std::mutex mutex;
+      measureContention("Mutex", mutex, n);
+      critical_section section;
+      measureContention("CriticalSection", section, n);
+   }
+}
+
+// Queue lock against the other locks as the contending cores grow,
+// up to twice the hardware threads to show the oversubscribed behavior
+void measureQueueLock() {
+   int cores = int(std::thread::hardware_concurrency());
+   for (int n = 1; n <= 2 * cores || n <= 2; n *= 2) {
+      McsLock mcslock;
+      measureContention("McsLock", mcslock, n);
+      SpinLock spinlock(SPINLOCK_CALL_SITE);
+      measureContention("SpinLock", spinlock, n);
+      std::mutex mutex;
+      measureContention("Mutex", mutex, n);
+      critical_section section;
+      measureContention("CriticalSection", section, n);
+   }
+}
+
+// Read-mostly table guarded by the exclusive, the shared and the sequence locks
+struct ConfigTable {
+   int values[8];
+};
+
+// single is the rate of one reader, set by the x1 run: the other runs print
+// and record their speedup over it, close to their thread count when the
+// readers don't contend
+template <class TRead>
+__declspec(noinline) void measureReaders(const char* title, int threads, const TRead& read, double& single) {
+   int count = 200000;
+   std::vector<std::thread> workers;
+   Chrono c;
+   c.Start();
+   for (int t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&read, count]() {
+         int sum = 0;
+         for (int i = 0; i < count; i++) {
+            sum += read();
+         }
+         sink += sum;
+      }));
+   }
+   for (auto& worker : workers) worker.join();
+   double ns = c.GetDiffDouble(Chrono::NS);
+   double ops = double(count) * threads;
+   double rate = ops * 1000.0 / ns;
+   if (threads == 1) single = rate;
+   printf("%s readers x%d = %lg Mops/s, %lg ns/read, %.2fx of x1\n", title, threads, rate, ns * threads / ops, rate / single);
+   char name[128];
+   snprintf(name, sizeof(name), "%s readers x%d", title, threads);
+   Benchmark::Record(name, rate, "Mops/s", false);
+   snprintf(name, sizeof(name), "%s readers x%d scaling", title, threads);
+   Benchmark::Record(name, rate / single, "x", false);
+}
+
+void measureReadMostly() {
+   ObjectLock<ConfigTable> exclusive("ConfigTable");
+   SharedObjectLock<ConfigTable> shared;
+   SharedObjectLock<ConfigTable> sharedWriter(true);
+   SeqLock<ConfigTable> sequence;
+   memset(&exclusive.data, 0, sizeof(ConfigTable));
+   memset(&shared.data, 0, sizeof(ConfigTable));
+   memset(&sharedWriter.data, 0, sizeof(ConfigTable));
+
+   int cores = int(std::thread::hardware_concurrency());
+   double single[4];
+   for (int n = 1; n <= 2 * cores || n <= 2; n *= 2) {
+      measureReaders("ObjectLock", n, [&exclusive]() {
+         SpinLockHolder holder(&exclusive);
+         return exclusive->values[0] + exclusive->values[7];
+      }, single[0]);
+      measureReaders("SharedObjectLock", n, [&shared]() {
+         RWSpinLockSharedHolder holder(&shared);
+         return shared->values[0] + shared->values[7];
+      }, single[1]);
+      measureReaders("SharedObjectLock writer-preferred", n, [&sharedWriter]() {
+         RWSpinLockSharedHolder holder(&sharedWriter);
+         return sharedWriter->values[0] + sharedWriter->values[7];
+      }, single[2]);
+      measureReaders("SeqLock", n, [&sequence]() {
+         ConfigTable table = sequence.load();
+         return table.values[0] + table.values[7];
+      }, single[3]);
+   }
+}
+
+// Every lock type from 1 thread up to twice the hardware threads,
+// with a short and a long critical section
+void recordLockBench(const char* title, const LockBench::Config& config, const LockBench::Result& result) {
+   LockBench::Print(title, config, result);
+   char name[128];
+   snprintf(name, sizeof(name), "%s x%d cs=%d", title, config.threads, config.criticalWork);
+   Benchmark::Record(name, result.opsPerSec / 1e6, "Mops/s", false);
+   snprintf(name, sizeof(name), "%s x%d cs=%d p99", title, config.threads, config.criticalWork);
+   Benchmark::Record(name, double(result.p99), "ns");
+}
+
+void measureLockBench() {
+   int cores = int(std::thread::hardware_concurrency());
+   const int criticalWorks[] = { 10, 200 };
+   for (int criticalWork : criticalWorks) {
+      for (int n = 1; n <= 2 * cores || n <= 2; n *= 2) {
+         LockBench::Config config(n, criticalWork, 100);
+         SpinLock spinlock;
+         recordLockBench("SpinLock", config, LockBench::Run(spinlock, config));
+         McsLock mcslock;
+         recordLockBench("McsLock", config, LockBench::Run(mcslock, config));
+         RWSpinLock rwlock;
+         recordLockBench("RWSpinLock", config, LockBench::Run(rwlock, config));
+         std::mutex mutex;
+         recordLockBench("Mutex", config, LockBench::Run(mutex, config));
+         critical_section section;
+         recordLockBench("CriticalSection", config, LockBench::Run(section, config));
+      }
+   }
+}
+
+// Mixed read/write workload on a hash map: one map behind one global lock,
+// against 64 shards each guarded by its stripe of a StripedLock. The
+// operation returns the number of keys its read found.
+typedef std::unordered_map<uint64_t, uint64_t> KeyValueMap;
+
+struct ShardedMap {
+   StripedLock<64> locks;
+   KeyValueMap shards[64];
+};
+
+template <class TOperation>
+__declspec(noinline) void measureMap(const char* title, int threads, const TOperation& operation) {
+   int count = 200000;
+   std::vector<std::thread> workers;
+   Chrono c;
    c.Start();
-   for (int i = 0; i < count; i++) {
-      task->execute();
+   for (int t = 0; t < threads; t++) {
+      workers.push_back(std::thread([&operation, count, t]() {
+         uint64_t random = 0x9E3779B97F4A7C15ull * (t + 1);
+         int found = 0;
+         for (int i = 0; i < count; i++) {
+            random = random * 6364136223846793005ull + 1442695040888963407ull;
+            uint64_t key = (random >> 33) % 100000;
+            found += operation(key, (random >> 20) % 10 == 0);   // 10% writes
+         }
+         sink += found;
+      }));
    }
-   printf("%s = %lg ns\n", title, c.GetDiffDouble(Chrono::NS) / double(count));
+   for (auto& worker : workers) worker.join();
+   double ns = c.GetDiffDouble(Chrono::NS);
+   double ops = double(count) * threads;
+   printf("%s x%d = %lg Mops/s\n", title, threads, ops * 1000.0 / ns);
+   char name[128];
+   snprintf(name, sizeof(name), "%s x%d", title, threads);
+   Benchmark::Record(name, ops * 1000.0 / ns, "Mops/s", false);
+}
+
+void measureStripedMap() {
+   int cores = int(std::thread::hardware_concurrency());
+   for (int n = 1; n <= 2 * cores || n <= 2; n *= 2) {
+      ObjectLock<KeyValueMap> global("KeyValueMap");
+      measureMap("Map global lock", n, [&global](uint64_t key, bool write) {
+         SpinLockHolder holder(&global);
+         if (write) (*global)[key]++;
+         return write ? 0 : int(global->count(key));
+      });
+      ShardedMap sharded;
+      measureMap("Map striped locks", n, [&sharded](uint64_t key, bool write) {
+         size_t index = sharded.locks.index(key);
+         SpinLockHolder holder(&sharded.locks.stripe(index));
+         if (write) sharded.shards[index][key]++;
+         return write ? 0 : int(sharded.shards[index].count(key));
+      });
+   }
+}
+
+// Reference pool: one std::deque behind a std::mutex, condition variables
+// to park the workers and the waiters
+class MutexQueuePool {
+   std::mutex guard;
+   std::condition_variable available, done;
+   std::deque<Task*> queue;
+   std::vector<std::thread> threads;
+   int pending;
+   bool stopping;
+public:
+   MutexQueuePool(int count) : pending(0), stopping(false) {
+      for (int i = 0; i < count; i++) {
+         threads.push_back(std::thread([this]() {
+            std::unique_lock<std::mutex> lock(guard);
+            for (;;) {
+               available.wait(lock, [this]() { return stopping || !queue.empty(); });
+               if (queue.empty()) return;
+               Task* task = queue.front();
+               queue.pop_front();
+               lock.unlock();
+               task->execute();
+               lock.lock();
+               if (--pending == 0) done.notify_all();
+            }
+         }));
+      }
+   }
+   ~MutexQueuePool() {
+      {
+         std::lock_guard<std::mutex> lock(guard);
+         stopping = true;
+      }
+      available.notify_all();
+      for (auto& thread : threads) thread.join();
+   }
+   void submit(Task* task) {
+      {
+         std::lock_guard<std::mutex> lock(guard);
+         queue.push_back(task);
+         pending++;
+      }
+      available.notify_one();
+   }
+   void wait_all() {
+      std::unique_lock<std::mutex> lock(guard);
+      done.wait(lock, [this]() { return pending == 0; });
+   }
+};
+
+// Task recording its delay between submit and execution
+class LatencyTask : public Task {
+public:
+   uint64_t submitted;
+   uint64_t latency;
+   int work;
+   virtual void execute() {
+      latency = LockBench::Now() - submitted;
+      LockBench::Work(work);
+   }
+};
+
+template <class TPool>
+__declspec(noinline) void measurePool(const char* title, TPool& pool, int work) {
+   int count = 100000;
+   std::vector<LatencyTask> tasks(count);
+   Chrono c;
+   c.Start();
+   for (auto& task : tasks) {
+      task.work = work;
+      task.submitted = LockBench::Now();
+      pool.submit(&task);
+   }
+   pool.wait_all();
+   double ns = c.GetDiffDouble(Chrono::NS);
+   std::vector<uint64_t> latencies;
+   for (auto& task : tasks) latencies.push_back(task.latency);
+   std::sort(latencies.begin(), latencies.end());
+   printf("%s work=%d = %lg Mtasks/s, latency p50=%llu p99=%llu p999=%llu ns\n", title, work, count * 1000.0 / ns,
+      (unsigned long long)latencies[count / 2], (unsigned long long)latencies[count * 99 / 100],
+      (unsigned long long)latencies[count * 999 / 1000]);
+   char name[128];
+   snprintf(name, sizeof(name), "%s work=%d", title, work);
+   Benchmark::Record(name, count * 1000.0 / ns, "Mtasks/s", false);
+   snprintf(name, sizeof(name), "%s work=%d p99", title, work);
+   Benchmark::Record(name, double(latencies[count * 99 / 100]), "ns");
+}
+
+void measureThreadPool() {
+   int workers = int(std::thread::hardware_concurrency());
+   ThreadPool pool(workers);
+   MutexQueuePool mutexPool(workers);
+   const int works[] = { 100, 1000 };
+   for (int work : works) {
+      measurePool("ThreadPool", pool, work);
+      measurePool("MutexQueuePool", mutexPool, work);
+   }
+
+   std::atomic<int64_t> sum(0);
+   Chrono c;
+   c.Start();
+   pool.parallel_for(0, 10000000, 10000, [&sum](int64_t i) {
+      if ((i & 0xffff) == 0) sum += i;
+   });
+   double ms = c.GetDiffDouble(Chrono::MS);
+   printf("ThreadPool parallel_for = %lg ms (sum %lld)\n", ms, (long long)sum.load());
+   Benchmark::Record("ThreadPool parallel_for", ms, "ms");
+}
+
+// Many small parallel_for, from outside and from inside the tasks: each must
+// see all its indexes and return only once its tasks let go of its counter
+void testParallelFor(int rounds) {
+   ThreadPool pool(int(std::thread::hardware_concurrency()) + 1);
+   for (int round = 0; round < rounds; round++) {
+      int64_t n = 1 + round % 64, grain = 1 + round % 3;
+      std::atomic<int64_t> sum(0);
+      pool.parallel_for(0, n, grain, [&sum](int64_t i) { sum += i; });
+      if (sum.load() != n * (n - 1) / 2) throw "parallel_for missed an index";
+
+      std::atomic<int64_t> nested(0);
+      pool.parallel_for(0, 4, 1, [&pool, &nested, n](int64_t) {
+         pool.parallel_for(0, n, 1, [&nested](int64_t i) { nested += i; });
+      });
+      if (nested.load() != 4 * (n * (n - 1) / 2)) throw "nested parallel_for missed an index";
+   }
+   printf("%d parallel_for rounds complete\n", rounds);
+}
+
+// Reference queue: std::deque behind a std::mutex, blocking pop
+class MutexDequeQueue {
+   std::mutex guard;
+   std::condition_variable available;
+   std::deque<Task*> queue;
+public:
+   MutexDequeQueue(size_t /*capacity*/) {
+   }
+   void push_n(Task* const* items, size_t n) {
+      {
+         std::lock_guard<std::mutex> lock(guard);
+         queue.insert(queue.end(), items, items + n);
+      }
+      available.notify_all();
+   }
+   size_t pop_n(Task** items, size_t n) {
+      std::unique_lock<std::mutex> lock(guard);
+      available.wait(lock, [this]() { return !queue.empty(); });
+      size_t count = 0;
+      for (; count < n && !queue.empty(); count++) {
+         items[count] = queue.front();
+         queue.pop_front();
+      }
+      return count;
+   }
+};
+
+// Producers pass Task pointers to the consumers by batches of batch items
+template <class TQueue>
+__declspec(noinline) void measureQueue(const char* title, int producers, int consumers, size_t batch) {
+   const size_t count = 200000;   // Items per producer
+   TQueue queue(1024);
+   std::atomic<uint64_t> received(0), checksum(0);
+   std::vector<std::thread> threads;
+   Chrono c;
+   c.Start();
+   for (int p = 0; p < producers; p++) {
+      threads.push_back(std::thread([&queue, batch, count]() {
+         std::vector<Task*> items(batch);
+         for (size_t i = 1; i <= count; i += batch) {
+            size_t n = std::min(batch, count + 1 - i);
+            for (size_t j = 0; j < n; j++) items[j] = (Task*)(uintptr_t)(i + j);
+            queue.push_n(items.data(), n);
+         }
+      }));
+   }
+   uint64_t total = uint64_t(count) * producers;
+   for (int k = 0; k < consumers; k++) {
+      threads.push_back(std::thread([&queue, &received, &checksum, batch, total, consumers, k]() {
+         // Consumers stop on the end markers pushed below
+         std::vector<Task*> items(batch);
+         uint64_t sum = 0;
+         for (bool stop = false; !stop; ) {
+            size_t n = queue.pop_n(items.data(), batch);
+            for (size_t j = 0; j < n; j++) {
+               if (items[j] != 0) sum += (uintptr_t)items[j];
+               else if (!stop) stop = true;
+               else queue.push_n(&items[j], 1);   // Marker of another consumer
+            }
+            received += n;
+         }
+         checksum += sum;
+      }));
+   }
+   for (int p = 0; p < producers; p++) threads[p].join();
+   for (int k = 0; k < consumers; k++) {
+      Task* marker = 0;
+      queue.push_n(&marker, 1);
+   }
+   for (auto& thread : threads) if (thread.joinable()) thread.join();
+   double ns = c.GetDiffDouble(Chrono::NS);
+   uint64_t expected = uint64_t(producers) * (uint64_t(count) * (count + 1) / 2);
+   printf("%s P%d C%d batch=%d = %lg Mitems/s%s\n", title, producers, consumers, int(batch), total * 1000.0 / ns,
+      checksum.load() == expected ? "" : " (BAD CHECKSUM)");
+   char name[128];
+   snprintf(name, sizeof(name), "%s P%d C%d batch=%d", title, producers, consumers, int(batch));
+   Benchmark::Record(name, total * 1000.0 / ns, "Mitems/s", false);
+}
+
+typedef BlockingRing<MpmcRing<Task*>, Task*> MpmcQueue;
+typedef BlockingRing<SpscRing<Task*>, Task*> SpscQueue;
+
+void measureRingQueues() {
+   const int counts[] = { 1, 2, 4, 8 };
+   for (int producers : counts) {
+      for (int consumers : counts) {
+         measureQueue<MpmcQueue>("MpmcRing", producers, consumers, 1);
+         measureQueue<MpmcQueue>("MpmcRing", producers, consumers, 16);
+         measureQueue<MutexDequeQueue>("MutexDeque", producers, consumers, 1);
+      }
+   }
+   measureQueue<SpscQueue>("SpscRing", 1, 1, 1);
+   measureQueue<SpscQueue>("SpscRing", 1, 1, 16);
+}
+
+// Cost of an empty read-side critical section
+__declspec(noinline) void measureEpochGuard() {
+   Chrono c;
+   c.PerfTest("EpochGuard enter/exit", []() { EpochGuard guard; });
+}
+
+// Readers look up keys while writers keep removing and inserting keys:
+// the retired nodes must be freed as fast as they come
+__declspec(noinline) void measureLockFreeList(int readers, int writers) {
+   const uint64_t range = 2000;
+   LockFreeList list;
+   for (uint64_t key = 0; key < range; key += 2) list.insert(key);
+
+   std::atomic<bool> stop(false);
+   std::atomic<uint64_t> reads(0), writes(0);
+   std::vector<std::thread> threads;
+   for (int t = 0; t < readers + writers; t++) {
+      bool writer = t >= readers;
+      threads.push_back(std::thread([&, writer, t]() {
+         uint64_t random = 0x9E3779B97F4A7C15ull * (t + 1);
+         uint64_t count = 0;
+         int found = 0;
+         while (!stop.load(std::memory_order_relaxed)) {
+            random = random * 6364136223846793005ull + 1442695040888963407ull;
+            uint64_t key = (random >> 33) % range;
+            if (!writer) {
+               found += list.contains(key);
+            }
+            else if (!list.remove(key)) {
+               list.insert(key);
+            }
+            count++;
+         }
+         (writer ? writes : reads) += count;
+         sink += found;
+      }));
+   }
+
+   size_t maxPending = 0;
+   Chrono c;
+   c.Start();
+   while (c.GetDiffDouble(Chrono::MS) < 500) {
+      size_t pending = EpochReclaimer::PendingCount();
+      if (pending > maxPending) maxPending = pending;
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+   }
+   stop = true;
+   for (auto& thread : threads) thread.join();
+   double seconds = c.GetDiffDouble(Chrono::S);
+   printf("LockFreeList readers=%d writers=%d = %lg Mreads/s %lg Mwrites/s, retired pending max=%d end=%d\n",
+      readers, writers, reads.load() / seconds / 1e6, writes.load() / seconds / 1e6,
+      int(maxPending), int(EpochReclaimer::PendingCount()));
+   char name[128];
+   snprintf(name, sizeof(name), "LockFreeList readers=%d writers=%d reads", readers, writers);
+   Benchmark::Record(name, reads.load() / seconds / 1e6, "Mops/s", false);
+   snprintf(name, sizeof(name), "LockFreeList readers=%d writers=%d pending max", readers, writers);
+   Benchmark::Record(name, double(maxPending), "objects");
+}
+
+void measureEpochReclaimer() {
+   measureEpochGuard();
+   int cores = int(std::thread::hardware_concurrency());
+   if (cores < 2) cores = 2;
+   measureLockFreeList(cores, 0);
+   measureLockFreeList(cores, 1);
+   measureLockFreeList(cores, 2);
 }
 
 void main() {
    printf("sizeof(CRITICAL_SECTION) = %d\n", sizeof(CRITICAL_SECTION));
-   measureTask("ThreadId", ThreadId_task);
-   measureTask("CriticalSection", CriticalSection_task);
-   measureTask("Mutex", Mutex_task);
+   testParallelFor(20000);
+   Benchmark::Register("tasks", []() {
+      measureTask("ThreadId", ThreadId_task);
+      measureTask("CriticalSection", CriticalSection_task);
+      measureTask("Mutex", Mutex_task);
+   });
+   Benchmark::Register("contention", measureContentionModes);
+   Benchmark::Register("queuelock", measureQueueLock);
+   Benchmark::Register("readmostly", measureReadMostly);
+   Benchmark::Register("lockbench", measureLockBench);
+   Benchmark::Register("stripedmap", measureStripedMap);
+   Benchmark::Register("threadpool", measureThreadPool);
+   Benchmark::Register("ringqueues", measureRingQueues);
+   Benchmark::Register("ebr", measureEpochReclaimer);
+   Benchmark::Run("SyncPattern");
+   LockProfiler::Dump(stdout, 10);
 }
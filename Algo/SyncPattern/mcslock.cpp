@@ -0,0 +1,42 @@
+
+#include "mcslock.h"
+#include <thread>
+
+// NOTE on the node state values:
+//
+// kNodeWaiting: queued, the owner of the node spins on it
+// kNodeSleeping: queued, the owner of the node is parked on it
+// kNodeGranted: the predecessor has handed off the lock
+
+static const int kMcsSpinCount = 1000;
+
+void McsLock::slowLock(Node* node) {
+   // Spin on our own node until the predecessor hands off
+   if (SpinLock::IsAdaptiveSpin()) {
+      for (int c = 0; c < kMcsSpinCount; c++) {
+         if (node->state.load(std::memory_order_acquire) == kNodeGranted) {
+            return;
+         }
+         SpinlockPause();
+      }
+   }
+
+   // Park, unless the lock was handed off meanwhile
+   tSpinWord state = kNodeWaiting;
+   if (!node->state.compare_exchange_strong(state, kNodeSleeping, std::memory_order_acquire)) {
+      return;
+   }
+   for (int loop = 1; node->state.load(std::memory_order_acquire) != kNodeGranted; loop++) {
+      SpinLock::SpinlockWait((int*)&node->state, kNodeSleeping, loop);
+   }
+}
+
+McsLock::Node* McsLock::waitNext(Node* node) {
+   // A successor has swapped the tail but not linked itself yet
+   for (int c = 0;; c++) {
+      Node* next = node->next.load(std::memory_order_acquire);
+      if (next) return next;
+      if (c < kMcsSpinCount) SpinlockPause();
+      else std::this_thread::yield();
+   }
+}
@@ -0,0 +1,107 @@
+#ifndef BASE_MCSLOCK_H_
+#define BASE_MCSLOCK_H_
+
+#include "spinlock.h"
+
+// MCS queue lock for heavily contended locks: each waiter appends a node to
+// the queue and spins on its own cache line instead of the shared lock word,
+// the lock is handed off to the waiters in FIFO order. Waiters that spin too
+// long park on their node with the SpinLock futex machinery.
+// Same API as SpinLock, a lock must be unlocked by the thread that locked it.
+class McsLock {
+public:
+   struct alignas(64) Node {
+      std::atomic<Node*> next;
+      std::atomic<tSpinWord> state;
+   };
+
+   McsLock() : tail_(0), owner_(0) {
+   }
+
+   inline void lock() {
+      Node* node = AllocNode();
+      node->next.store(0, std::memory_order_relaxed);
+      node->state.store(kNodeWaiting, std::memory_order_relaxed);
+      Node* pred = tail_.exchange(node, std::memory_order_acq_rel);
+      if (pred) {
+         pred->next.store(node, std::memory_order_release);
+         slowLock(node);
+      }
+      owner_ = node;
+   }
+
+   inline bool tryLock() {
+      Node* node = AllocNode();
+      node->next.store(0, std::memory_order_relaxed);
+      Node* expected = 0;
+      if (tail_.compare_exchange_strong(expected, node, std::memory_order_acquire)) {
+         owner_ = node;
+         return true;
+      }
+      FreeNode(node);
+      return false;
+   }
+
+   inline void unlock() {
+      Node* node = owner_;
+      Node* next = node->next.load(std::memory_order_acquire);
+      if (!next) {
+         Node* expected = node;
+         if (tail_.compare_exchange_strong(expected, 0, std::memory_order_release)) {
+            FreeNode(node);
+            return;
+         }
+         next = waitNext(node);
+      }
+      // Hand off to the successor, wake it if parked
+      if (next->state.exchange(kNodeGranted, std::memory_order_release) == kNodeSleeping) {
+         SpinLock::SpinlockWake((int*)&next->state);
+      }
+      FreeNode(node);
+   }
+
+   inline bool isHeld() const {
+      return tail_.load() != 0;
+   }
+
+private:
+   enum {
+      kNodeGranted = 0,
+      kNodeWaiting = 1,
+      kNodeSleeping = 2,
+      kMaxHeldLocks = 16   // Queue locks held at once by a thread
+   };
+
+   // Per-thread nodes, a node is in use from lock() to unlock()
+   struct NodePool {
+      Node nodes[kMaxHeldLocks];
+      Node* free[kMaxHeldLocks];
+      int count;
+      NodePool() : count(kMaxHeldLocks) {
+         for (int i = 0; i < kMaxHeldLocks; i++) free[i] = &nodes[i];
+      }
+   };
+   static NodePool& Pool() {
+      static thread_local NodePool pool;
+      return pool;
+   }
+   static Node* AllocNode() {
+      NodePool& pool = Pool();
+      if (pool.count == 0) throw "too many queue locks held";
+      return pool.free[--pool.count];
+   }
+   static void FreeNode(Node* node) {
+      NodePool& pool = Pool();
+      pool.free[pool.count++] = node;
+   }
+
+   std::atomic<Node*> tail_;
+   Node* owner_;   // Node of the holder, only accessed by the holder
+
+   void slowLock(Node* node);
+   Node* waitNext(Node* node);
+};
+
+typedef LockHolder<McsLock> McsLockHolder;
+
+#endif  // BASE_MCSLOCK_H_
@@ -0,0 +1,304 @@
+#ifndef BASE_RINGQUEUE_H_
+#define BASE_RINGQUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "spinlock.h"
+
+// Bounded lock-free ring queues, the capacity is rounded up to a power of 2.
+// Producer and consumer positions are on separate cache lines.
+// try_push_n/try_pop_n move up to n items and return how many they moved.
+
+// Multi-producer multi-consumer ring of D. Vyukov: each cell has a sequence
+// number telling whether it is ready for the producer or the consumer of
+// the current lap, so producers and consumers only contend on their own position.
+template <class T>
+class MpmcRing {
+public:
+
+   MpmcRing(size_t capacity) {
+      size_t size = 2;
+      while (size < capacity) size <<= 1;
+      mask_ = size - 1;
+      cells_ = new Cell[size];
+      for (size_t i = 0; i < size; i++) cells_[i].sequence.store(i, std::memory_order_relaxed);
+      enqueuePos_.store(0, std::memory_order_relaxed);
+      dequeuePos_.store(0, std::memory_order_relaxed);
+   }
+
+   ~MpmcRing() {
+      delete[] cells_;
+   }
+
+   size_t capacity() const {
+      return mask_ + 1;
+   }
+
+   // Claimed positions, the last pushes may not be poppable yet
+   size_t size() const {
+      size_t dequeuePos = dequeuePos_.load();
+      size_t enqueuePos = enqueuePos_.load();
+      return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+   }
+
+   bool try_push(const T& item) {
+      return try_push_n(&item, 1) == 1;
+   }
+
+   bool try_pop(T& item) {
+      return try_pop_n(&item, 1) == 1;
+   }
+
+   size_t try_push_n(const T* items, size_t n) {
+      size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+      size_t count;
+      for (;;) {
+         // Count the free cells of this lap from pos, they stay free until
+         // claimed since only the producer owning a position fills its cell
+         count = 0;
+         while (count < n) {
+            size_t sequence = cells_[(pos + count) & mask_].sequence.load(std::memory_order_acquire);
+            intptr_t dif = intptr_t(sequence) - intptr_t(pos + count);
+            if (dif != 0) {
+               if (dif > 0 && count == 0) count = size_t(-1);   // pos is stale
+               break;
+            }
+            count++;
+         }
+         if (count == size_t(-1)) {
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+            continue;
+         }
+         if (count == 0) return 0;   // Full
+         if (enqueuePos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) break;
+      }
+      for (size_t i = 0; i < count; i++) {
+         Cell& cell = cells_[(pos + i) & mask_];
+         cell.data = items[i];
+         cell.sequence.store(pos + i + 1, std::memory_order_release);
+      }
+      return count;
+   }
+
+   size_t try_pop_n(T* items, size_t n) {
+      size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+      size_t count;
+      for (;;) {
+         count = 0;
+         while (count < n) {
+            size_t sequence = cells_[(pos + count) & mask_].sequence.load(std::memory_order_acquire);
+            intptr_t dif = intptr_t(sequence) - intptr_t(pos + count + 1);
+            if (dif != 0) {
+               if (dif > 0 && count == 0) count = size_t(-1);   // pos is stale
+               break;
+            }
+            count++;
+         }
+         if (count == size_t(-1)) {
+            pos = dequeuePos_.load(std::memory_order_relaxed);
+            continue;
+         }
+         if (count == 0) return 0;   // Empty
+         if (dequeuePos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) break;
+      }
+      for (size_t i = 0; i < count; i++) {
+         Cell& cell = cells_[(pos + i) & mask_];
+         items[i] = cell.data;
+         cell.sequence.store(pos + i + mask_ + 1, std::memory_order_release);
+      }
+      return count;
+   }
+
+private:
+   struct Cell {
+      std::atomic<size_t> sequence;
+      T data;
+   };
+
+   char padding0_[64];
+   Cell* cells_;
+   size_t mask_;
+   char padding1_[64];
+   std::atomic<size_t> enqueuePos_;
+   char padding2_[64];
+   std::atomic<size_t> dequeuePos_;
+   char padding3_[64];
+};
+
+// Single-producer single-consumer ring, wait-free: each side owns its
+// position and caches the last seen position of the other side, so the
+// shared cache lines are only read when the cached view looks full or empty.
+template <class T>
+class SpscRing {
+public:
+
+   SpscRing(size_t capacity) : cachedHead_(0), cachedTail_(0) {
+      size_t size = 2;
+      while (size < capacity) size <<= 1;
+      mask_ = size - 1;
+      items_ = new T[size];
+      tail_.store(0, std::memory_order_relaxed);
+      head_.store(0, std::memory_order_relaxed);
+   }
+
+   ~SpscRing() {
+      delete[] items_;
+   }
+
+   size_t capacity() const {
+      return mask_ + 1;
+   }
+
+   size_t size() const {
+      size_t head = head_.load();
+      return tail_.load() - head;
+   }
+
+   bool try_push(const T& item) {
+      return try_push_n(&item, 1) == 1;
+   }
+
+   bool try_pop(T& item) {
+      return try_pop_n(&item, 1) == 1;
+   }
+
+   // Producer thread only
+   size_t try_push_n(const T* items, size_t n) {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      size_t free = mask_ + 1 - (tail - cachedHead_);
+      if (free < n) {
+         cachedHead_ = head_.load(std::memory_order_acquire);
+         free = mask_ + 1 - (tail - cachedHead_);
+      }
+      size_t count = n < free ? n : free;
+      for (size_t i = 0; i < count; i++) items_[(tail + i) & mask_] = items[i];
+      tail_.store(tail + count, std::memory_order_release);
+      return count;
+   }
+
+   // Consumer thread only
+   size_t try_pop_n(T* items, size_t n) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      size_t used = cachedTail_ - head;
+      if (used < n) {
+         cachedTail_ = tail_.load(std::memory_order_acquire);
+         used = cachedTail_ - head;
+      }
+      size_t count = n < used ? n : used;
+      for (size_t i = 0; i < count; i++) items[i] = items_[(head + i) & mask_];
+      head_.store(head + count, std::memory_order_release);
+      return count;
+   }
+
+private:
+   char padding0_[64];
+   T* items_;
+   size_t mask_;
+   char padding1_[64];
+   std::atomic<size_t> tail_;   // Producer side
+   size_t cachedHead_;
+   char padding2_[64];
+   std::atomic<size_t> head_;   // Consumer side
+   size_t cachedTail_;
+   char padding3_[64];
+};
+
+// Blocking push/pop over a ring: spin a while, then park on a futex word
+// with the SpinLock machinery. The other side wakes the parked threads
+// only when there are some.
+template <class TRing, class T>
+class BlockingRing {
+public:
+
+   BlockingRing(size_t capacity)
+      : ring_(capacity), notEmpty_(0), notFull_(0), popWaiters_(0), pushWaiters_(0) {
+   }
+
+   TRing& ring() {
+      return ring_;
+   }
+
+   void push(const T& item) {
+      push_n(&item, 1);
+   }
+
+   T pop() {
+      T item;
+      pop_n(&item, 1);
+      return item;
+   }
+
+   // Push all the n items
+   void push_n(const T* items, size_t n) {
+      for (int loop = 1; n > 0; ) {
+         size_t count = ring_.try_push_n(items, n);
+         if (count) {
+            items += count;
+            n -= count;
+            Wake(notEmpty_, popWaiters_, count);
+            loop = 1;
+            continue;
+         }
+         Wait(notFull_, pushWaiters_, loop++, [this]() { return IsFull(); });
+      }
+   }
+
+   // Pop between 1 and n items
+   size_t pop_n(T* items, size_t n) {
+      for (int loop = 1;; ) {
+         size_t count = ring_.try_pop_n(items, n);
+         if (count) {
+            Wake(notFull_, pushWaiters_, count);
+            return count;
+         }
+         Wait(notEmpty_, popWaiters_, loop++, [this]() { return IsEmpty(); });
+      }
+   }
+
+private:
+   enum { kSpinCount = 100 };
+
+   TRing ring_;
+   std::atomic<tSpinWord> notEmpty_;   // Futex words, bumped to wake the waiters
+   std::atomic<tSpinWord> notFull_;
+   std::atomic<int> popWaiters_;
+   std::atomic<int> pushWaiters_;
+
+   bool IsFull() {
+      return ring_.size() >= ring_.capacity();
+   }
+   bool IsEmpty() {
+      return ring_.size() == 0;
+   }
+
+   // The wait condition is rechecked after registering as waiter,
+   // so that a wake in between is not lost
+   template <class TBlocked>
+   static void Wait(std::atomic<tSpinWord>& word, std::atomic<int>& waiters, int loop, const TBlocked& blocked) {
+      if (loop <= kSpinCount && SpinLock::IsAdaptiveSpin()) {
+         SpinlockPause();
+         return;
+      }
+      tSpinWord epoch = word.load();
+      waiters.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (blocked()) SpinLock::SpinlockWait((int*)&word, epoch, loop);
+      waiters.fetch_sub(1);
+   }
+
+   // Each item moved wakes one waiter of the other side at most,
+   // no herd of waiters for a single free cell
+   static void Wake(std::atomic<tSpinWord>& word, std::atomic<int>& waiters, size_t count) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int parked = waiters.load(std::memory_order_relaxed);
+      if (parked > 0) {
+         word.fetch_add(1);
+         SpinLock::SpinlockWakeN((int*)&word, int(std::min(count, size_t(parked))));
+      }
+   }
+};
+
+#endif  // BASE_RINGQUEUE_H_
@@ -0,0 +1,101 @@
+#include "rwspinlock.h"
+
+// NOTE on the state word:
+//
+// kWriter is set while a writer holds the lock, or waits for the readers
+// that were in when it set it,
+// kWriterWaiting is set by the waiting writers with writer preference,
+// the writer that gets the lock clears it, the others set it again.
+// The readers holding the lock are counted on the stripes, not here.
+//
+// Parked threads wait on generation_, the releases bump it and wake them
+// all when waiters_ is not zero, then they retry to get the lock.
+
+static const int kRWSpinCount = 1000;
+
+void RWSpinLock::slowLock() {
+   for (int loop = 1;; loop++) {
+      int spin = SpinLock::IsAdaptiveSpin() ? kRWSpinCount : 1;
+      for (int c = 0; c < spin; c++) {
+         int32_t state = state_.load(std::memory_order_relaxed);
+         // Without writer preference, don't stop the readers while they are in
+         if ((state & ~kWriterWaiting) == 0 && (preferWriter_ || !hasReaders())) {
+            if (state_.compare_exchange_weak(state, kWriter)) {
+               if (!hasReaders() || drainReaders()) {
+                  return; // Lock acquire
+               }
+            }
+            continue;
+         }
+         if (preferWriter_ && (state & kWriterWaiting) == 0) {
+            state_.fetch_or(kWriterWaiting, std::memory_order_relaxed);
+         }
+         SpinlockPause();
+      }
+
+      // Register as waiter before the last check of the state,
+      // so that a release in between bumps the generation we wait on.
+      tSpinWord generation = generation_.load();
+      waiters_.fetch_add(1);
+      if ((state_.load() & ~kWriterWaiting) != 0 || hasReaders()) {
+         SpinLock::SpinlockWait((int*)&generation_, generation, loop);
+      }
+      waiters_.fetch_sub(1);
+   }
+}
+
+// The writer holds kWriter and readers are in. With writer preference it keeps
+// the bit, which stops the new readers, and waits for the readers to leave.
+// Without, it lets the readers go on and retries once they are out.
+bool RWSpinLock::drainReaders() {
+   if (!preferWriter_) {
+      this->unlock();
+      return false;
+   }
+   for (int loop = 1;; loop++) {
+      int spin = SpinLock::IsAdaptiveSpin() ? kRWSpinCount : 1;
+      for (int c = 0; c < spin; c++) {
+         if (!hasReaders()) return true;
+         SpinlockPause();
+      }
+
+      tSpinWord generation = generation_.load();
+      waiters_.fetch_add(1);
+      if (hasReaders()) {
+         SpinLock::SpinlockWait((int*)&generation_, generation, loop);
+      }
+      waiters_.fetch_sub(1);
+   }
+}
+
+void RWSpinLock::slowLockShared(std::atomic<int32_t>& count) {
+   // Leave the stripe while a writer is there, the writer may wait for it
+   leaveShared(count);
+   for (int loop = 1;; loop++) {
+      int spin = SpinLock::IsAdaptiveSpin() ? kRWSpinCount : 1;
+      for (int c = 0; c < spin; c++) {
+         if ((state_.load(std::memory_order_relaxed) & readerBlockers()) == 0) {
+            count.fetch_add(1);
+            if ((state_.load() & readerBlockers()) == 0) {
+               return; // Lock acquire
+            }
+            leaveShared(count);
+            continue;
+         }
+         SpinlockPause();
+      }
+
+      tSpinWord generation = generation_.load();
+      waiters_.fetch_add(1);
+      if ((state_.load() & readerBlockers()) != 0) {
+         SpinLock::SpinlockWait((int*)&generation_, generation, loop);
+      }
+      waiters_.fetch_sub(1);
+   }
+}
+
+void RWSpinLock::wakeWaiters() {
+   // wake all: readers may all proceed, writers retry
+   generation_.fetch_add(1);
+   SpinLock::SpinlockWake((int*)&generation_, true);
+}
@@ -0,0 +1,143 @@
+#ifndef BASE_RWSPINLOCK_H_
+#define BASE_RWSPINLOCK_H_
+
+#include "spinlock.h"
+
+// Reader-writer spinlock for read-mostly data: readers share the lock,
+// a writer holds it alone. The readers count themselves on per-thread
+// stripes, each alone on its cache line, so that readers on different
+// cores don't write a common line; the state word keeps the writer bits,
+// which the readers only read, and a writer sums the stripes to wait for
+// the readers in. With writer preference, a waiting writer stops the new
+// readers so that it can't be starved by a stream of readers; without,
+// a writer only gets the lock while no reader holds it.
+// Contended threads spin then park on a wake generation word with the
+// SpinLock futex machinery.
+class RWSpinLock {
+public:
+
+   RWSpinLock(bool preferWriter = false)
+      : state_(0), generation_(0), waiters_(0), preferWriter_(preferWriter) {
+      for (auto& stripe : readers_) stripe.count.store(0, std::memory_order_relaxed);
+   }
+
+   // Exclusive lock
+   inline void lock() {
+      int32_t state = 0;
+      if (!state_.compare_exchange_strong(state, kWriter) || (hasReaders() && !drainReaders())) {
+         slowLock();
+      }
+   }
+
+   inline bool tryLock() {
+      int32_t state = 0;
+      if (!state_.compare_exchange_strong(state, kWriter)) return false;
+      if (!hasReaders()) return true;
+      unlock();
+      return false;
+   }
+
+   inline void unlock() {
+      state_.fetch_and(~kWriter);
+      if (waiters_.load() != 0) wakeWaiters();
+   }
+
+   // Shared lock: count the reader on its stripe, then check for a writer.
+   // Both are sequentially consistent, as the writer sets its bit then sums
+   // the stripes: one of them sees the other.
+   inline void lockShared() {
+      std::atomic<int32_t>& count = readerStripe();
+      count.fetch_add(1);
+      if ((state_.load() & readerBlockers()) != 0) slowLockShared(count);
+   }
+
+   inline bool tryLockShared() {
+      std::atomic<int32_t>& count = readerStripe();
+      count.fetch_add(1);
+      if ((state_.load() & readerBlockers()) == 0) return true;
+      leaveShared(count);
+      return false;
+   }
+
+   inline void unlockShared() {
+      leaveShared(readerStripe());
+   }
+
+   inline bool isHeld() const {
+      return (state_.load() & kWriter) != 0 || hasReaders();
+   }
+
+private:
+   enum {
+      kStripes = 16,
+      kWriterWaiting = 1 << 29,      // A writer waits, with writer preference
+      kWriter = 1 << 30              // A writer holds the lock, or drains the readers
+   };
+
+   struct alignas(64) ReaderStripe {
+      std::atomic<int32_t> count;    // Readers of the threads of the stripe holding the lock
+   };
+
+   std::atomic<int32_t> state_;
+   std::atomic<tSpinWord> generation_;   // Futex word, bumped when waiters must recheck
+   std::atomic<int32_t> waiters_;        // Parked threads
+   const bool preferWriter_;
+   ReaderStripe readers_[kStripes];
+
+   inline int32_t readerBlockers() const {
+      return preferWriter_ ? (kWriter | kWriterWaiting) : kWriter;
+   }
+
+   // Stripe of the calling thread, the threads are spread in turn
+   inline std::atomic<int32_t>& readerStripe() {
+      static std::atomic<int> nextStripe(0);
+      static thread_local int stripe = nextStripe.fetch_add(1) % kStripes;
+      return readers_[stripe].count;
+   }
+
+   inline bool hasReaders() const {
+      for (auto& stripe : readers_) {
+         if (stripe.count.load() != 0) return true;
+      }
+      return false;
+   }
+
+   // The last reader of a stripe wakes the writer waiting for the readers
+   inline void leaveShared(std::atomic<int32_t>& count) {
+      if (count.fetch_sub(1) == 1 && waiters_.load() != 0) wakeWaiters();
+   }
+
+   void slowLock();
+   void slowLockShared(std::atomic<int32_t>& count);
+   bool drainReaders();
+   void wakeWaiters();
+};
+
+// Scoped shared lock of a lock with the RWSpinLock API
+template <class TLock>
+struct SharedLockHolder {
+private:
+  TLock* guard;
+public:
+  SharedLockHolder(TLock* guard) {
+    this->guard = guard;
+    this->guard->lockShared();
+  }
+  ~SharedLockHolder() {
+    this->guard->unlockShared();
+  }
+};
+
+typedef LockHolder<RWSpinLock> RWSpinLockHolder;
+typedef SharedLockHolder<RWSpinLock> RWSpinLockSharedHolder;
+
+// Counterpart of ObjectLock for read-mostly data
+template <class T>
+struct SharedObjectLock : RWSpinLock {
+  T data;
+  SharedObjectLock(bool preferWriter = false) : RWSpinLock(preferWriter) {}
+  T* operator -> () { return &data; }
+  T& operator * () { return data; }
+};
+
+#endif  // BASE_RWSPINLOCK_H_
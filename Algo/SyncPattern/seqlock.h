@@ -0,0 +1,63 @@
+#ifndef BASE_SEQLOCK_H_
+#define BASE_SEQLOCK_H_
+
+#include <string.h>
+#include <thread>
+#include "spinlock.h"
+
+// Sequence lock for small POD data read far more often than written:
+// readers never write shared memory, they copy the data and retry when
+// the sequence shows a concurrent write. Writers serialize on a SpinLock
+// and make the sequence odd while they write.
+template <class T>
+class SeqLock {
+public:
+
+   SeqLock() : sequence_(0) {
+      memset((void*)&data_, 0, sizeof(data_));
+   }
+
+   SeqLock(const T& value) : sequence_(0) {
+      memcpy((void*)&data_, &value, sizeof(data_));
+   }
+
+   T load() const {
+      T value;
+      for (int c = 0;; c++) {
+         uint32_t sequence = sequence_.load(std::memory_order_acquire);
+         if ((sequence & 1) == 0) {
+            memcpy(&value, (const void*)&data_, sizeof(value));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence_.load(std::memory_order_relaxed) == sequence) {
+               return value;
+            }
+         }
+         // The writer may be preempted in its copy
+         if (c < kSpinCount) SpinlockPause();
+         else std::this_thread::yield();
+      }
+   }
+
+   void store(const T& value) {
+      SpinLockHolder holder(&writer_);
+      uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+      sequence_.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      memcpy((void*)&data_, &value, sizeof(data_));
+      sequence_.store(sequence + 2, std::memory_order_release);
+   }
+
+   // Sequence of the last write, even when no write is in progress
+   inline uint32_t sequence() const {
+      return sequence_.load(std::memory_order_acquire);
+   }
+
+private:
+   enum { kSpinCount = 1000 };
+
+   std::atomic<uint32_t> sequence_;
+   SpinLock writer_;
+   volatile T data_;
+};
+
+#endif  // BASE_SEQLOCK_H_
@@ -1,7 +1,6 @@
 
 #include "spinlock.h"
-
-#include <intrin.h>
+#include <thread>
 
 // NOTE on the Lock-state values:
 //
@@ -9,9 +8,11 @@
 // kSpinLockHeld represents the locked state with no waiters
 // kSpinLockSleeper represents the locked state with waiters
 
-static int adaptive_spin_count = 0;
+static bool adaptive_spin_enabled = true;
 
+#if !defined(__linux__)
 static int SuggestedDelayNS(int loop);
+#endif
 
 /*******************************************************
 **** FOR _WIN32
@@ -26,7 +27,9 @@ void SpinLock::SpinlockWait(volatile tSpinWord *w, int32_t value, int loop) {
       Sleep(SuggestedDelayNS(loop) / 1000000);
    }
 }
-void SpinLock::SpinlockWake(volatile tSpinWord *w) {
+void SpinLock::SpinlockWake(volatile tSpinWord *w, bool all) {
+}
+void SpinLock::SpinlockWakeN(volatile tSpinWord *w, int count) {
 }
 
 /*******************************************************
@@ -34,13 +37,14 @@ void SpinLock::SpinlockWake(volatile tSpinWord *w) {
 *******************************************************/
 #elif defined(__linux__)
 #include <errno.h>
-#include <sched.h>
 #include <time.h>
 #include <limits.h>
-#include "base/linux_syscall_support.h"
-#define FUTEX_WAIT 0
-#define FUTEX_WAKE 1
-#define FUTEX_PRIVATE_FLAG 128
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+static long sys_futex(volatile tSpinWord *w, int op, int value) {
+   return syscall(SYS_futex, reinterpret_cast<int *>(const_cast<tSpinWord *>(w)), op, value, NULL, NULL, 0);
+}
 static bool have_futex;
 static int futex_private_flag = FUTEX_PRIVATE_FLAG;
 static struct InitModule {
@@ -49,9 +53,9 @@ static struct InitModule {
       // futexes are ints, so we can use them only when
       // that's the same size as the lockword_ in spinlock.
       have_futex = (sizeof (tSpinWord) == sizeof (int) &&
-         sys_futex(&x, FUTEX_WAKE, 1, NULL, NULL, 0) >= 0);
+         sys_futex(&x, FUTEX_WAKE, 1) >= 0);
       if (have_futex &&
-         sys_futex(&x, FUTEX_WAKE | futex_private_flag, 1, NULL, NULL, 0) < 0) {
+         sys_futex(&x, FUTEX_WAKE | futex_private_flag, 1) < 0) {
             futex_private_flag = 0;
       }
    }
@@ -59,30 +63,29 @@ static struct InitModule {
 void SpinLock::SpinlockWait(volatile tSpinWord *w, int32_t value, int loop) {
    if (loop != 0) {
       int save_errno = errno;
-      struct timespec tm;
-      tm.tv_sec = 0;
       if (have_futex) {
-         tm.tv_nsec = SuggestedDelayNS(loop);
+         // Sleep until the lock word is no longer value and unlock() wakes us,
+         // returns at once when the lock word has already changed
+         sys_futex(w, FUTEX_WAIT | futex_private_flag, value);
       } else {
+         struct timespec tm;
+         tm.tv_sec = 0;
          tm.tv_nsec = 2000001;   // above 2ms so linux 2.4 doesn't spin
-      }
-      if (have_futex) {
-         tm.tv_nsec *= 16;  // increase the delay; we expect explicit wakeups
-         sys_futex(reinterpret_cast<int *>(const_cast<tSpinWord *>(w)),
-            FUTEX_WAIT | futex_private_flag,
-            value, reinterpret_cast<struct kernel_timespec *>(&tm),
-            NULL, 0);
-      } else {
          nanosleep(&tm, NULL);
       }
       errno = save_errno;
    }
 }
-void SpinLock::SpinlockWake(volatile tSpinWord *w) {
+void SpinLock::SpinlockWake(volatile tSpinWord *w, bool all) {
    if (have_futex) {
-      sys_futex(reinterpret_cast<int *>(const_cast<tSpinWord *>(w)),
-         FUTEX_WAKE | futex_private_flag, all? INT_MAX : 1,
-         NULL, NULL, 0);
+      // SpinLock wakes a single waiter: it takes the lock as kSpinLockSleeper,
+      // so its own unlock() wakes the next one
+      sys_futex(w, FUTEX_WAKE | futex_private_flag, all ? INT_MAX : 1);
+   }
+}
+void SpinLock::SpinlockWakeN(volatile tSpinWord *w, int count) {
+   if (have_futex) {
+      sys_futex(w, FUTEX_WAKE | futex_private_flag, count);
    }
 }
 
@@ -109,52 +112,91 @@ void SpinLock::SpinlockWait(volatile tSpinWord *w, int32_t value, int loop) {
    }
    errno = save_errno;
 }
-void SpinLock::SpinlockWake(volatile tSpinWord *w) {
+void SpinLock::SpinlockWake(volatile tSpinWord *w, bool all) {
+}
+void SpinLock::SpinlockWakeN(volatile tSpinWord *w, int count) {
 }
 #endif
 
-inline static void SpinlockPause() {
-#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
-  __asm__ __volatile__("rep; nop" : : );
-#else
-  __nop();
-#endif
+// Spinning only helps when the owner runs on another cpu
+static struct InitAdaptiveSpin {
+   InitAdaptiveSpin() {
+      adaptive_spin_enabled = std::thread::hardware_concurrency() > 1;
+   }
+} init_adaptive_spin;
+
+bool SpinLock::SetAdaptiveSpin(bool enabled) {
+   bool previous = adaptive_spin_enabled;
+   adaptive_spin_enabled = enabled;
+   return previous;
 }
 
-void SpinLock::slowLock() {
-   for(int lock_wait_call_count=1;;lock_wait_call_count++) {
+bool SpinLock::IsAdaptiveSpin() {
+   return adaptive_spin_enabled;
+}
 
-      // Spin to give this thread some chance of obtaining the lock without wait.
-      //   Monitor the lock to see if its value changes within some time
-      //   period (adaptive_spin_count loop iterations). The last value read
-      //   from the lock is returned from the method.
-      int c = adaptive_spin_count;
-      while (lockword_.load() != kSpinLockFree && --c > 0) {
-         SpinlockPause();
+// Spin to give this thread some chance of obtaining the lock without wait,
+// as the glibc adaptive mutex: spin up to twice the average spin count that
+// obtained this lock before, then fold the spins of this call in the average.
+// Locks held briefly converge to a small budget that succeeds, locks held
+// longer than kMaxSpinCount iterations stop spinning and sleep at once.
+bool SpinLock::spinLock() {
+   int spinCount = spinCount_.load(std::memory_order_relaxed);
+   int maxSpin = spinCount * 2 + 10;
+   if (maxSpin > kMaxSpinCount) maxSpin = kMaxSpinCount;
+
+   for (int c = 0; c < maxSpin; c++) {
+      if (lockword_.load(std::memory_order_relaxed) == kSpinLockFree) {
+         tSpinWord lock_value = kSpinLockFree;
+         if (lockword_.compare_exchange_weak(lock_value, kSpinLockHeld)) {
+            spinCount_.store(spinCount + (c - spinCount) / 8, std::memory_order_relaxed);
+            return true; // Lock acquire
+         }
       }
+      SpinlockPause();
+   }
+   spinCount_.store(spinCount + (maxSpin - spinCount) / 8, std::memory_order_relaxed);
+   return false;
+}
+
+#ifdef SPINLOCK_PROFILE
+void SpinLock::slowLock() {
+   uint64_t start = LockProfiler::Now();
+   waitLock();
+   LockProfiler::OnAcquire(profileId_, true, LockProfiler::Now() - start);
+}
+#else
+void SpinLock::slowLock() {
+   waitLock();
+}
+#endif
+
+void SpinLock::waitLock() {
+   if (adaptive_spin_enabled && spinLock()) {
+      return;
+   }
+
+   for(int lock_wait_call_count=1;;lock_wait_call_count++) {
 
       // If the lock is currently held, but not marked as having a sleeper, mark
       // it as having a sleeper.
       tSpinWord lock_value = kSpinLockFree;
-      if(lockword_.compare_exchange_weak(lock_value, kSpinLockSleeper)) {
+      if(lockword_.compare_exchange_strong(lock_value, kSpinLockSleeper)) {
          return; // Lock acquire
       }
       else if(lock_value == kSpinLockHeld) {
          // Here, just "mark" that the thread is going to sleep.  Don't store the
          // lock wait time in the lock as that will cause the current lock
          // owner to think it experienced contention.
-         if (lockword_.compare_exchange_weak(lock_value, kSpinLockSleeper)) {
+         if (lockword_.compare_exchange_strong(lock_value, kSpinLockSleeper)) {
             // Successfully transitioned to kSpinLockSleeper.  Pass
             // kSpinLockSleeper to the SpinlockWait routine to properly indicate
             // the last lock_value observed.
             lock_value = kSpinLockSleeper;
          } else if (lock_value == kSpinLockFree) {
-            // Lock is free again, so try and acquire it before sleeping.  The
-            // new lock state will be the number of cycles this thread waited if
-            // this thread obtains the lock.
-            if(lockword_.compare_exchange_weak(lock_value, kSpinLockSleeper)) {
-               return; // Lock acquire
-            }
+            // Lock is free again, retry to acquire it before sleeping.
+            // Never wait on a free lock word: no unlock() would wake us.
+            continue;
          }
       }
 
@@ -168,6 +210,7 @@ void SpinLock::slowUnlock() {
    SpinlockWake((int*)&lockword_);
 }
 
+#if !defined(__linux__)
 // Return a suggested delay in nanoseconds for iteration number "loop"
 static int SuggestedDelayNS(int loop) {
    // Weak pseudo-random number generator to get some spread between threads
@@ -186,8 +229,6 @@ static int SuggestedDelayNS(int loop) {
    // Select top 20..24 bits of lower 48 bits,
    // giving approximately 0ms to 16ms.
    // Mean is exponential in loop for first 32 iterations, then 8ms.
-   // The futex path multiplies this by 16, since we expect explicit wakeups
-   // almost always on that path.
    return r >> (44 - (loop >> 3));
 #else
    static std::atomic<tSpinWord> rand;
@@ -203,8 +244,7 @@ static int SuggestedDelayNS(int loop) {
    // Select top 20..24 bits of lower 31 bits,
    // giving approximately 0ms to 16ms.
    // Mean is exponential in loop for first 32 iterations, then 8ms.
-   // The futex path multiplies this by 16, since we expect explicit wakeups
-   // almost always on that path.
    return r >> (12 - (loop >> 3));
 #endif
 }
+#endif
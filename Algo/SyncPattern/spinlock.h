@@ -2,16 +2,39 @@
 #ifndef BASE_SPINLOCK_H_
 #define BASE_SPINLOCK_H_
 
-#include "index.h"
+#include <stdint.h>
+#include <atomic>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "lockprofile.h"
 
 typedef int tSpinWord;
 
+// Hint the cpu that we are in a spin-wait loop
+inline static void SpinlockPause() {
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  __asm__ __volatile__("rep; nop" : : );
+#elif defined(_MSC_VER)
+  __nop();
+#endif
+}
+
 //#define DISABLE_LOCK
 
+// Count acquisitions, contention and hold times per lock, see lockprofile.h
+//#define SPINLOCK_PROFILE
+
 class SpinLock {
 public:
 
-   SpinLock() : lockword_(kSpinLockFree) {
+   // name labels the lock in the profiling dump, eg. SPINLOCK_CALL_SITE
+   SpinLock(const char* name = 0) : lockword_(kSpinLockFree), spinCount_(0) {
+#ifdef SPINLOCK_PROFILE
+      profileId_ = LockProfiler::Register(name);
+#else
+      (void)name;
+#endif
    }
 
    inline void lock() {
@@ -20,13 +43,24 @@ public:
       if(!lockword_.compare_exchange_weak(lockValue, kSpinLockHeld)) {
          slowLock();
       }
+#ifdef SPINLOCK_PROFILE
+      else LockProfiler::OnAcquire(profileId_, false, 0);
+      heldSince_ = LockProfiler::Now();
+#endif
 #endif
    }
 
    inline bool tryLock() {
 #ifndef DISABLE_LOCK
       tSpinWord lockValue = kSpinLockFree;
+#ifdef SPINLOCK_PROFILE
+      if (!lockword_.compare_exchange_weak(lockValue, kSpinLockHeld)) return false;
+      LockProfiler::OnAcquire(profileId_, false, 0);
+      heldSince_ = LockProfiler::Now();
+      return true;
+#else
       return lockword_.compare_exchange_weak(lockValue, kSpinLockHeld);
+#endif
 #else
       return true;
 #endif
@@ -34,6 +68,9 @@ public:
 
    inline void unlock() {
 #ifndef DISABLE_LOCK
+#ifdef SPINLOCK_PROFILE
+      LockProfiler::OnRelease(profileId_, LockProfiler::Now() - heldSince_);
+#endif
       uint64_t prev_value = static_cast<uint64_t>(lockword_.exchange(kSpinLockFree));
       if (prev_value != kSpinLockHeld) slowUnlock();
 #endif
@@ -47,8 +84,19 @@ public:
 #endif
    }
 
+   // Average spin iterations that obtained the lock in slowLock
+   inline int spinCount() const {
+      return spinCount_.load(std::memory_order_relaxed);
+   }
+
    static void SpinlockWait(volatile tSpinWord *at, int32_t value, int loop);
-   static void SpinlockWake(volatile tSpinWord *at);
+   static void SpinlockWake(volatile tSpinWord *at, bool all = false);
+   static void SpinlockWakeN(volatile tSpinWord *at, int count);   // Wake up to count waiters
+
+   // Enable the spinning before sleep in slowLock (default: on multi-core),
+   // return the previous setting
+   static bool SetAdaptiveSpin(bool enabled);
+   static bool IsAdaptiveSpin();
 
 private:
    enum { 
@@ -57,7 +105,19 @@ private:
       kSpinLockSleeper = 2 
    };
 
+   enum {
+      kMaxSpinCount = 1000   // Bound of the adaptive spin iterations
+   };
+
    std::atomic<tSpinWord> lockword_;
+   std::atomic<int32_t> spinCount_;
+#ifdef SPINLOCK_PROFILE
+   uint32_t profileId_;
+   uint64_t heldSince_;   // Only accessed by the holder
+#endif
+
+   bool spinLock();
+   void waitLock();
 
    void slowLock();
    void slowUnlock();
@@ -66,23 +126,35 @@ private:
 template <class T>
 struct ObjectLock : SpinLock {
   T data;
+  ObjectLock(const char* name = 0) : SpinLock(name) {}
   T* operator -> () { return &data; }
   T& operator * () { return data; }
 };
 
+// ObjectLock alone on its cache lines: no false sharing between the
+// neighbors in an array of locked objects
+template <class T>
+struct alignas(64) PaddedObjectLock : ObjectLock<T> {
+  PaddedObjectLock(const char* name = 0) : ObjectLock<T>(name) {}
+};
 
-struct SpinLockHolder {
+
+// Scoped lock/unlock of any lock with the SpinLock API
+template <class TLock>
+struct LockHolder {
 private:
-  SpinLock* guard;
+  TLock* guard;
 public:
-  SpinLockHolder(SpinLock* guard) {
+  LockHolder(TLock* guard) {
     this->guard = guard;
     this->guard->lock();
   }
-  ~SpinLockHolder() {
+  ~LockHolder() {
     this->guard->unlock();
   }
 };
 
+typedef LockHolder<SpinLock> SpinLockHolder;
+
 
 #endif  // BASE_SPINLOCK_H_
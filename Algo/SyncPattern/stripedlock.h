@@ -0,0 +1,74 @@
+#ifndef BASE_STRIPEDLOCK_H_
+#define BASE_STRIPEDLOCK_H_
+
+#include <stddef.h>
+#include "spinlock.h"
+
+// N SpinLocks each alone on its cache line, a key is hashed to one of them.
+// Guards the N shards of a data structure: index(key) selects the shard
+// that the lock of the key protects.
+template <size_t N>
+class StripedLock {
+public:
+
+   static inline size_t index(uint64_t key) {
+      // Finalizer of MurmurHash3, so that sequential keys spread on all stripes
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdull;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ull;
+      key ^= key >> 33;
+      return (N & (N - 1)) == 0 ? size_t(key & (N - 1)) : size_t(key % N);
+   }
+
+   inline SpinLock& get(uint64_t key) {
+      return stripes[index(key)].lock;
+   }
+   inline SpinLock& stripe(size_t i) {
+      return stripes[i].lock;
+   }
+   static inline size_t size() {
+      return N;
+   }
+
+   inline void lock(uint64_t key) {
+      get(key).lock();
+   }
+   inline bool tryLock(uint64_t key) {
+      return get(key).tryLock();
+   }
+   inline void unlock(uint64_t key) {
+      get(key).unlock();
+   }
+
+   // Lock all the stripes, always in the same order to avoid deadlocks
+   void lockAll() {
+      for (size_t i = 0; i < N; i++) stripes[i].lock.lock();
+   }
+   void unlockAll() {
+      for (size_t i = N; i > 0; i--) stripes[i - 1].lock.unlock();
+   }
+
+private:
+   struct alignas(64) Stripe {
+      SpinLock lock;
+   };
+   Stripe stripes[N];
+};
+
+// Scoped lock of the stripe of a key
+template <size_t N>
+struct StripedLockHolder {
+private:
+  SpinLock* guard;
+public:
+  StripedLockHolder(StripedLock<N>* striped, uint64_t key) {
+    this->guard = &striped->get(key);
+    this->guard->lock();
+  }
+  ~StripedLockHolder() {
+    this->guard->unlock();
+  }
+};
+
+#endif  // BASE_STRIPEDLOCK_H_
@@ -0,0 +1,9 @@
+#ifndef BASE_TASK_H_
+#define BASE_TASK_H_
+
+class Task {
+public:
+   virtual void execute() = 0;
+};
+
+#endif  // BASE_TASK_H_
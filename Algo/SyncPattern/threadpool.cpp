@@ -0,0 +1,269 @@
+
+#include "threadpool.h"
+
+/*******************************************************
+**** WorkStealingDeque
+*******************************************************/
+// Memory orders from "Correct and Efficient Work-Stealing for Weak
+// Memory Models", Le, Pop, Cohen, Zappa Nardelli, PPoPP 2013.
+
+WorkStealingDeque::Buffer::Buffer(int64_t capacity) : mask(capacity - 1) {
+   tasks = new std::atomic<Task*>[size_t(capacity)];
+}
+
+WorkStealingDeque::Buffer::~Buffer() {
+   delete[] tasks;
+}
+
+WorkStealingDeque::WorkStealingDeque(int64_t capacity) : top_(0), bottom_(0) {
+   int64_t size = 1;
+   while (size < capacity) size <<= 1;
+   buffer_.store(new Buffer(size), std::memory_order_relaxed);
+}
+
+WorkStealingDeque::~WorkStealingDeque() {
+   delete buffer_.load(std::memory_order_relaxed);
+   for (Buffer* buffer : retired_) delete buffer;
+}
+
+WorkStealingDeque::Buffer* WorkStealingDeque::grow(Buffer* buffer, int64_t bottom, int64_t top) {
+   Buffer* grown = new Buffer((buffer->mask + 1) * 2);
+   for (int64_t i = top; i < bottom; i++) grown->put(i, buffer->get(i));
+   retired_.push_back(buffer);
+   buffer_.store(grown, std::memory_order_release);
+   return grown;
+}
+
+void WorkStealingDeque::push(Task* task) {
+   int64_t bottom = bottom_.load(std::memory_order_relaxed);
+   int64_t top = top_.load(std::memory_order_acquire);
+   Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+   if (bottom - top > buffer->mask) {
+      buffer = grow(buffer, bottom, top);
+   }
+   buffer->put(bottom, task);
+   std::atomic_thread_fence(std::memory_order_release);
+   bottom_.store(bottom + 1, std::memory_order_relaxed);
+}
+
+Task* WorkStealingDeque::pop() {
+   int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+   Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+   bottom_.store(bottom, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t top = top_.load(std::memory_order_relaxed);
+   if (top > bottom) {
+      // Empty
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return 0;
+   }
+   Task* task = buffer->get(bottom);
+   if (top == bottom) {
+      // Last task, race against the thieves
+      if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+         task = 0;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+   }
+   return task;
+}
+
+Task* WorkStealingDeque::steal() {
+   int64_t top = top_.load(std::memory_order_acquire);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t bottom = bottom_.load(std::memory_order_acquire);
+   if (top >= bottom) return 0;
+   Buffer* buffer = buffer_.load(std::memory_order_acquire);
+   Task* task = buffer->get(top);
+   if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return 0;
+   }
+   return task;
+}
+
+/*******************************************************
+**** ThreadPool
+*******************************************************/
+// Worker of the current thread, if any
+static thread_local ThreadPool* current_pool = 0;
+static thread_local int current_worker = -1;
+
+static const int kStealRounds = 64;   // Rounds of steal attempts before parking
+
+ThreadPool::ThreadPool(int threads)
+   : injection_(0), pending_(0), wakeEpoch_(0), sleepers_(0), stopping_(false) {
+   if (threads <= 0) threads = int(std::thread::hardware_concurrency());
+   if (threads <= 0) threads = 1;
+   for (int i = 0; i < threads; i++) {
+      workers_.push_back(new WorkStealingDeque());
+   }
+   for (int i = 0; i < threads; i++) {
+      threads_.push_back(std::thread([this, i]() { this->workerLoop(i); }));
+   }
+}
+
+ThreadPool::~ThreadPool() {
+   this->wait_all();
+   stopping_.store(true);
+   wakeEpoch_.fetch_add(1);
+   SpinLock::SpinlockWake((int*)&wakeEpoch_, true);
+   for (auto& thread : threads_) thread.join();
+   for (WorkStealingDeque* worker : workers_) delete worker;
+}
+
+void ThreadPool::submit(Task* task) {
+   pending_.fetch_add(1);
+   if (current_pool == this) {
+      // Spawned by a task: keep it local, idle workers steal it
+      workers_[current_worker]->push(task);
+   }
+   else {
+      InjectedTask* injected = new InjectedTask();
+      injected->task = task;
+      injected->next = injection_.load(std::memory_order_relaxed);
+      while (!injection_.compare_exchange_weak(injected->next, injected)) {
+      }
+   }
+   this->notify();
+}
+
+// Wake one parked worker, if any. The fence orders the push of the task
+// before the read of sleepers_, the worker registers as sleeper before
+// checking the queues, so one of them sees the other.
+void ThreadPool::notify() {
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if (sleepers_.load() > 0) {
+      wakeEpoch_.fetch_add(1);
+      SpinLock::SpinlockWake((int*)&wakeEpoch_);
+   }
+}
+
+bool ThreadPool::hasWork() {
+   if (injection_.load() != 0) return true;
+   for (WorkStealingDeque* worker : workers_) {
+      if (!worker->empty()) return true;
+   }
+   return false;
+}
+
+Task* ThreadPool::findTask(int index) {
+   // Own deque first, newest task is the cache hottest
+   if (index >= 0) {
+      Task* task = workers_[index]->pop();
+      if (task) return task;
+   }
+
+   // Then the injected tasks: take the whole stack, keep the oldest one
+   // and move the others to our deque where idle workers can steal them
+   InjectedTask* injected = injection_.load() ? injection_.exchange(0) : 0;
+   if (injected) {
+      InjectedTask* reversed = 0;
+      while (injected) {
+         InjectedTask* next = injected->next;
+         injected->next = reversed;
+         reversed = injected;
+         injected = next;
+      }
+      Task* task = reversed->task;
+      InjectedTask* rest = reversed->next;
+      delete reversed;
+      if (index < 0 && rest) {
+         // No deque outside of the workers: give them back
+         InjectedTask* last = rest;
+         while (last->next) last = last->next;
+         last->next = injection_.load(std::memory_order_relaxed);
+         while (!injection_.compare_exchange_weak(last->next, rest)) {
+         }
+         this->notify();
+      }
+      else if (rest) {
+         // Push newest first so that pop() runs them oldest first
+         std::vector<Task*> tasks;
+         for (InjectedTask* it = rest; it; ) {
+            tasks.push_back(it->task);
+            InjectedTask* next = it->next;
+            delete it;
+            it = next;
+         }
+         for (size_t i = tasks.size(); i > 0; i--) workers_[index]->push(tasks[i - 1]);
+         this->notify();
+      }
+      return task;
+   }
+
+   // Then steal, starting from the next worker
+   int count = int(workers_.size());
+   for (int i = 1; i <= count; i++) {
+      int victim = (index + i + count) % count;
+      if (victim == index) continue;
+      Task* task = workers_[victim]->steal();
+      if (task) return task;
+   }
+   return 0;
+}
+
+void ThreadPool::runTask(Task* task) {
+   task->execute();
+   if (pending_.fetch_sub(1) == 1) {
+      SpinLock::SpinlockWake((int*)&pending_, true);
+   }
+}
+
+void ThreadPool::workerLoop(int index) {
+   current_pool = this;
+   current_worker = index;
+   for (int idle = 0;; ) {
+      Task* task = this->findTask(index);
+      if (task) {
+         this->runTask(task);
+         idle = 0;
+         continue;
+      }
+      if (++idle < kStealRounds) {
+         SpinlockPause();
+         continue;
+      }
+
+      // Park until a submit bumps the epoch
+      tSpinWord epoch = wakeEpoch_.load();
+      sleepers_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (stopping_.load()) {
+         sleepers_.fetch_sub(1);
+         break;
+      }
+      if (!this->hasWork()) {
+         SpinLock::SpinlockWait((int*)&wakeEpoch_, epoch, idle - kStealRounds + 1);
+      }
+      sleepers_.fetch_sub(1);
+   }
+   current_pool = 0;
+   current_worker = -1;
+}
+
+// Run one pending task from the calling thread
+bool ThreadPool::helpOne() {
+   Task* task = this->findTask(current_pool == this ? current_worker : -1);
+   if (!task) return false;
+   this->runTask(task);
+   return true;
+}
+
+// Wait for the counter to fall to until, running tasks meanwhile so that
+// a waiting task doesn't keep its worker idle
+void ThreadPool::waitCounter(std::atomic<tSpinWord>* counter, tSpinWord until) {
+   for (int loop = 1;; loop++) {
+      tSpinWord value = counter->load();
+      if (value <= until) return;
+      if (this->helpOne()) {
+         loop = 0;
+         continue;
+      }
+      if (loop < kStealRounds) SpinlockPause();
+      else SpinLock::SpinlockWait((int*)counter, value, loop - kStealRounds + 1);
+   }
+}
+
+void ThreadPool::wait_all() {
+   this->waitCounter(&pending_);
+}
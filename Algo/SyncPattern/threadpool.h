@@ -0,0 +1,134 @@
+#ifndef BASE_THREADPOOL_H_
+#define BASE_THREADPOOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "spinlock.h"
+#include "task.h"
+
+// Chase-Lev work-stealing deque of tasks: the owner thread pushes and pops
+// at the bottom, the other threads steal at the top. The circular buffer
+// grows when full, the old buffers are freed with the deque.
+class WorkStealingDeque {
+public:
+   WorkStealingDeque(int64_t capacity = 256);
+   ~WorkStealingDeque();
+
+   // Owner thread only
+   void push(Task* task);
+   Task* pop();
+
+   // Any thread, null when empty or when another thief won the race
+   Task* steal();
+
+   bool empty() const {
+      return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+   }
+
+private:
+   struct Buffer {
+      int64_t mask;
+      std::atomic<Task*>* tasks;
+      Buffer(int64_t capacity);
+      ~Buffer();
+      Task* get(int64_t i) {
+         return tasks[i & mask].load(std::memory_order_relaxed);
+      }
+      void put(int64_t i, Task* task) {
+         tasks[i & mask].store(task, std::memory_order_relaxed);
+      }
+   };
+
+   std::atomic<int64_t> top_;       // Thieves side
+   char padding1_[64];
+   std::atomic<int64_t> bottom_;    // Owner side
+   std::atomic<Buffer*> buffer_;
+   std::vector<Buffer*> retired_;   // Grown out buffers, thieves may still read them
+   char padding2_[64];
+
+   Buffer* grow(Buffer* buffer, int64_t bottom, int64_t top);
+};
+
+// Thread pool running Task objects: each worker owns a work-stealing deque,
+// tasks submitted from outside go through a lock-free injection stack, idle
+// workers steal from the others then park on a futex word.
+// The pool doesn't own the tasks, they must live until executed.
+class ThreadPool {
+public:
+   ThreadPool(int threads = 0);   // 0: one worker per hardware thread
+   ~ThreadPool();                 // Wait for the submitted tasks, then stop the workers
+
+   int size() const {
+      return int(workers_.size());
+   }
+
+   void submit(Task* task);
+
+   // Wait until all the submitted tasks are executed, the calling thread
+   // runs tasks meanwhile. Not from inside a task: it would wait for itself.
+   void wait_all();
+
+   // Call fn(i) for i in [begin, end) on the workers, by chunks of grain indexes,
+   // return when all are done. Can be called from inside a task.
+   template <class TFunction>
+   void parallel_for(int64_t begin, int64_t end, int64_t grain, const TFunction& fn) {
+      if (begin >= end) return;
+      if (grain < 1) grain = 1;
+      int64_t chunks = (end - begin + grain - 1) / grain;
+      std::vector<RangeTask<TFunction>> tasks;
+      tasks.reserve(size_t(chunks));
+      // One count per chunk plus one, released by the last chunk once its
+      // wake returned: the tasks and the counter live until then
+      std::atomic<tSpinWord> remaining((tSpinWord)chunks + 1);
+      for (int64_t i = begin; i < end; i += grain) {
+         tasks.push_back(RangeTask<TFunction>(fn, i, i + grain < end ? i + grain : end, &remaining));
+      }
+      for (auto& task : tasks) this->submit(&task);
+      this->waitCounter(&remaining, 1);
+      while (remaining.load() != 0) std::this_thread::yield();
+   }
+
+private:
+   struct InjectedTask {
+      Task* task;
+      InjectedTask* next;
+   };
+
+   template <class TFunction>
+   struct RangeTask : Task {
+      const TFunction* fn;
+      int64_t begin, end;
+      std::atomic<tSpinWord>* remaining;
+      RangeTask(const TFunction& fn, int64_t begin, int64_t end, std::atomic<tSpinWord>* remaining)
+         : fn(&fn), begin(begin), end(end), remaining(remaining) {
+      }
+      virtual void execute() {
+         for (int64_t i = begin; i < end; i++) (*fn)(i);
+         std::atomic<tSpinWord>* counter = remaining;
+         if (counter->fetch_sub(1) == 2) {
+            SpinLock::SpinlockWake((int*)counter, true);
+            counter->store(0);
+         }
+      }
+   };
+
+   std::vector<WorkStealingDeque*> workers_;
+   std::vector<std::thread> threads_;
+   std::atomic<InjectedTask*> injection_;
+   std::atomic<tSpinWord> pending_;     // Submitted tasks not yet executed
+   std::atomic<tSpinWord> wakeEpoch_;   // Futex word of the parked workers
+   std::atomic<int> sleepers_;
+   std::atomic<bool> stopping_;
+
+   void workerLoop(int index);
+   Task* findTask(int index);
+   bool hasWork();
+   void runTask(Task* task);
+   void notify();
+   bool helpOne();
+   void waitCounter(std::atomic<tSpinWord>* counter, tSpinWord until = 0);
+};
+
+#endif  // BASE_THREADPOOL_H_
@@ -0,0 +1,14 @@
+#include "benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Compare two benchmark result files written with BENCH_JSON,
+// exit with the number of regressions
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    printf("usage: BenchCompare baseline.json current.json [threshold %%, default 5]\n");
+    return -1;
+  }
+  double threshold = argc > 3 ? atof(argv[3]) / 100 : 0.05;
+  return Benchmark::Compare(argv[1], argv[2], threshold);
+}
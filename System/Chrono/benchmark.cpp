@@ -0,0 +1,411 @@
+#include "benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+
+struct RegisteredBenchmark {
+  std::string name;
+  std::function<void()> fn;
+};
+
+static std::vector<RegisteredBenchmark>& Registry() {
+  static std::vector<RegisteredBenchmark> registry;
+  return registry;
+}
+
+static std::vector<Benchmark::Result>& AllResults() {
+  static std::vector<Benchmark::Result> results;
+  return results;
+}
+
+static std::string running_benchmark;
+static std::map<std::string, int> record_occurrences;   // Of the running benchmark
+static std::map<std::string, size_t> result_index;
+
+void Benchmark::Register(const char* name, const std::function<void()>& fn) {
+  RegisteredBenchmark benchmark = { name, fn };
+  Registry().push_back(benchmark);
+}
+
+int Benchmark::Run(const char* module) {
+  const char* filter = getenv("BENCH_FILTER");
+  const char* repeatText = getenv("BENCH_REPEAT");
+  int repeat = repeatText ? atoi(repeatText) : 1;
+  if (repeat < 1) repeat = 1;
+
+  for (int i = 0; i < repeat; i++) {
+    for (auto& benchmark : Registry()) {
+      if (filter && !strstr(benchmark.name.c_str(), filter)) continue;
+      running_benchmark = benchmark.name;
+      record_occurrences.clear();
+      benchmark.fn();
+    }
+  }
+  running_benchmark.clear();
+
+  const char* jsonPath = getenv("BENCH_JSON");
+  if (jsonPath && !WriteJson(jsonPath, module, AllResults())) {
+    printf("Cannot write the benchmark results to %s\n", jsonPath);
+  }
+  const char* baselinePath = getenv("BENCH_BASELINE");
+  if (!baselinePath) return 0;
+  std::vector<Result> baseline;
+  if (!ReadJson(baselinePath, baseline)) {
+    printf("Cannot read the benchmark baseline %s\n", baselinePath);
+    return 0;
+  }
+  return Compare(baseline, AllResults());
+}
+
+void Benchmark::Record(const char* name, double value, const char* unit, bool lowerIsBetter) {
+  Record(name, std::vector<double>(1, value), unit, lowerIsBetter);
+}
+
+void Benchmark::Record(const char* name, const std::vector<double>& samples, const char* unit, bool lowerIsBetter) {
+  while (*name == ' ') name++;
+  std::string key = running_benchmark.empty() ? name : running_benchmark + "/" + name;
+  int occurrence = ++record_occurrences[key];
+  if (occurrence > 1) key += "#" + std::to_string(occurrence);
+
+  std::vector<Result>& results = AllResults();
+  auto found = result_index.find(key);
+  if (found == result_index.end()) {
+    Result result;
+    result.name = key;
+    result.unit = unit;
+    result.lowerIsBetter = lowerIsBetter;
+    found = result_index.insert(std::make_pair(key, results.size())).first;
+    results.push_back(result);
+  }
+  std::vector<double>& all = results[found->second].samples;
+  all.insert(all.end(), samples.begin(), samples.end());
+}
+
+const std::vector<Benchmark::Result>& Benchmark::Results() {
+  return AllResults();
+}
+
+/*******************************************************
+**** JSON files
+*******************************************************/
+
+static void WriteJsonString(FILE* file, const std::string& text) {
+  fputc('"', file);
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+    else if (c < 0x20) fprintf(file, "\\u%04x", c);
+    else fputc(c, file);
+  }
+  fputc('"', file);
+}
+
+bool Benchmark::WriteJson(const char* path, const char* module, const std::vector<Result>& results) {
+  FILE* file = fopen(path, "w");
+  if (!file) return false;
+  fprintf(file, "{\n  \"module\": ");
+  WriteJsonString(file, module);
+  fprintf(file, ",\n  \"results\": [");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& result = results[i];
+    fprintf(file, "%s\n    {\"name\": ", i ? "," : "");
+    WriteJsonString(file, result.name);
+    fprintf(file, ", \"unit\": ");
+    WriteJsonString(file, result.unit);
+    fprintf(file, ", \"lowerIsBetter\": %s, \"samples\": [", result.lowerIsBetter ? "true" : "false");
+    for (size_t j = 0; j < result.samples.size(); j++) {
+      fprintf(file, "%s%.9g", j ? ", " : "", result.samples[j]);
+    }
+    fprintf(file, "]}");
+  }
+  fprintf(file, "\n  ]\n}\n");
+  return fclose(file) == 0;
+}
+
+// Reader of the files written above, unknown members are skipped
+class JsonReader {
+  const char* p;
+public:
+  JsonReader(const char* text) : p(text) {
+  }
+
+  bool Expect(char c) {
+    this->SkipSpaces();
+    if (*p != c) return false;
+    p++;
+    return true;
+  }
+
+  bool String(std::string& text) {
+    if (!this->Expect('"')) return false;
+    text.clear();
+    for (; *p && *p != '"'; p++) {
+      if (*p != '\\') {
+        text.push_back(*p);
+        continue;
+      }
+      p++;
+      if (*p == 'u') {
+        text.push_back(char(strtol(std::string(p + 1, 4).c_str(), 0, 16)));
+        p += 4;
+      }
+      else if (*p == 'n') text.push_back('\n');
+      else if (*p == 't') text.push_back('\t');
+      else if (*p) text.push_back(*p);
+      else return false;
+    }
+    return this->Expect('"');
+  }
+
+  bool Number(double& value) {
+    this->SkipSpaces();
+    char* end;
+    value = strtod(p, &end);
+    if (end == p) return false;
+    p = end;
+    return true;
+  }
+
+  bool Bool(bool& value) {
+    this->SkipSpaces();
+    if (!strncmp(p, "true", 4)) value = true;
+    else if (!strncmp(p, "false", 5)) value = false;
+    else return false;
+    p += value ? 4 : 5;
+    return true;
+  }
+
+  bool Skip() {
+    this->SkipSpaces();
+    std::string text;
+    double number;
+    bool flag;
+    if (*p == '"') return this->String(text);
+    if (*p == '{' || *p == '[') {
+      char close = *p == '{' ? '}' : ']';
+      p++;
+      if (this->Expect(close)) return true;
+      do {
+        if (close == '}' && !(this->String(text) && this->Expect(':'))) return false;
+        if (!this->Skip()) return false;
+      } while (this->Expect(','));
+      return this->Expect(close);
+    }
+    if (!strncmp(p, "null", 4)) {
+      p += 4;
+      return true;
+    }
+    return this->Bool(flag) || this->Number(number);
+  }
+
+  bool Result(Benchmark::Result& result) {
+    if (!this->Expect('{')) return false;
+    result.lowerIsBetter = true;
+    std::string member;
+    if (this->Expect('}')) return true;
+    do {
+      if (!this->String(member) || !this->Expect(':')) return false;
+      bool ok;
+      if (member == "name") ok = this->String(result.name);
+      else if (member == "unit") ok = this->String(result.unit);
+      else if (member == "lowerIsBetter") ok = this->Bool(result.lowerIsBetter);
+      else if (member == "samples") ok = this->Samples(result.samples);
+      else ok = this->Skip();
+      if (!ok) return false;
+    } while (this->Expect(','));
+    return this->Expect('}');
+  }
+
+  bool Samples(std::vector<double>& samples) {
+    if (!this->Expect('[')) return false;
+    if (this->Expect(']')) return true;
+    do {
+      double value;
+      if (!this->Number(value)) return false;
+      samples.push_back(value);
+    } while (this->Expect(','));
+    return this->Expect(']');
+  }
+
+  bool Results(std::vector<Benchmark::Result>& results) {
+    if (!this->Expect('{')) return false;
+    std::string member;
+    if (this->Expect('}')) return true;
+    do {
+      if (!this->String(member) || !this->Expect(':')) return false;
+      if (member != "results") {
+        if (!this->Skip()) return false;
+        continue;
+      }
+      if (!this->Expect('[')) return false;
+      if (this->Expect(']')) continue;
+      do {
+        Benchmark::Result result;
+        if (!this->Result(result)) return false;
+        results.push_back(result);
+      } while (this->Expect(','));
+      if (!this->Expect(']')) return false;
+    } while (this->Expect(','));
+    return this->Expect('}');
+  }
+
+private:
+  void SkipSpaces() {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+  }
+};
+
+bool Benchmark::ReadJson(const char* path, std::vector<Result>& results) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  std::string text;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, size);
+  fclose(file);
+  results.clear();
+  return JsonReader(text.c_str()).Results(results);
+}
+
+/*******************************************************
+**** Comparison
+*******************************************************/
+
+static double Median(std::vector<double> samples) {
+  if (samples.empty()) return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  return n & 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
+
+static const double kSignificance = 0.01;
+static const size_t kExactSamples = 20;   // Exact U distribution up to this many samples per side
+
+// Number of orderings of n1 + n2 distinct values giving each U, from 0 to n1 * n2:
+// counts(i, j, u) = counts(i - 1, j, u - j) + counts(i, j - 1, u), the largest
+// value being from the first sample or from the second
+static std::vector<double> UCounts(size_t n1, size_t n2) {
+  size_t size = n1 * n2 + 1;
+  std::vector<std::vector<double>> previous(n2 + 1, std::vector<double>(size, 0)), counts = previous;
+  for (size_t j = 0; j <= n2; j++) previous[j][0] = 1;
+  for (size_t i = 1; i <= n1; i++) {
+    counts[0].assign(size, 0);
+    counts[0][0] = 1;
+    for (size_t j = 1; j <= n2; j++) {
+      for (size_t u = 0; u < size; u++) {
+        counts[j][u] = counts[j - 1][u] + (u >= j ? previous[j][u - j] : 0);
+      }
+    }
+    previous.swap(counts);
+  }
+  return previous[n2];
+}
+
+// Smallest two-sided p-value the test can give, the two samples fully apart
+static double MinimumP(size_t n1, size_t n2) {
+  double orderings = 1;
+  for (size_t k = 1; k <= n2; k++) orderings = orderings * double(n1 + k) / double(k);
+  return std::min(1.0, 2 / orderings);
+}
+
+// Two-sided p-value of the Mann-Whitney U test: no assumption on the
+// distribution of the samples, which have long tails for timings. Exact
+// distribution for small samples, ties given their average rank; normal
+// approximation with tie and continuity corrections above kExactSamples.
+static double MannWhitneyP(const std::vector<double>& a, const std::vector<double>& b) {
+  std::vector<std::pair<double, int>> all;
+  for (double value : a) all.push_back(std::make_pair(value, 0));
+  for (double value : b) all.push_back(std::make_pair(value, 1));
+  std::sort(all.begin(), all.end());
+
+  double n1 = double(a.size()), n2 = double(b.size()), n = n1 + n2;
+  double rankSum = 0, ties = 0;
+  for (size_t i = 0; i < all.size(); ) {
+    size_t j = i;
+    while (j < all.size() && all[j].first == all[i].first) j++;
+    double rank = double(i + j + 1) / 2;   // Average rank of the tied values, from 1
+    for (size_t k = i; k < j; k++) {
+      if (all[k].second == 0) rankSum += rank;
+    }
+    double t = double(j - i);
+    ties += t * t * t - t;
+    i = j;
+  }
+  double u = rankSum - n1 * (n1 + 1) / 2;
+  if (a.size() <= kExactSamples && b.size() <= kExactSamples) {
+    // Orderings at least as far from the mean as u
+    std::vector<double> counts = UCounts(a.size(), b.size());
+    double mean = n1 * n2 / 2, distance = fabs(u - mean) - 1e-9, extreme = 0, total = 0;
+    for (size_t k = 0; k < counts.size(); k++) {
+      total += counts[k];
+      if (fabs(double(k) - mean) >= distance) extreme += counts[k];
+    }
+    return extreme / total;
+  }
+  double sigma = sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+  if (sigma == 0) return 1;
+  double z = (fabs(u - n1 * n2 / 2) - 0.5) / sigma;
+  if (z < 0) z = 0;
+  return erfc(z / sqrt(2.0));
+}
+
+int Benchmark::Compare(const std::vector<Result>& baseline, const std::vector<Result>& current, double threshold) {
+  std::map<std::string, const Result*> byName;
+  for (auto& result : baseline) byName[result.name] = &result;
+
+  int regressions = 0, improvements = 0, unverified = 0;
+  printf("%-48s %12s %12s %9s %8s\n", "benchmark", "baseline", "current", "change", "p");
+  for (auto& result : current) {
+    auto found = byName.find(result.name);
+    double now = Median(result.samples);
+    if (found == byName.end()) {
+      printf("%-48s %12s %12.4g %9s %8s  new\n", result.name.c_str(), "-", now, "", "");
+      continue;
+    }
+    const Result& before = *found->second;
+    double then = Median(before.samples);
+    double change = then != 0 ? (now - then) / fabs(then) : (now == then ? 0 : now > then ? 1 : -1);
+    double worse = result.lowerIsBetter ? change : -change;
+
+    // Too few samples for the test to ever reach kSignificance, as a single
+    // measure on either side: a change past the threshold is only reported
+    bool sampled = before.samples.size() >= 2 && result.samples.size() >= 2;
+    bool testable = sampled && MinimumP(before.samples.size(), result.samples.size()) < kSignificance;
+    double p = sampled ? MannWhitneyP(before.samples, result.samples) : 1;
+    bool significant = testable && p < kSignificance;
+    const char* verdict = "";
+    if (!testable && fabs(worse) > threshold) {
+      verdict = "unverified";
+      unverified++;
+    }
+    else if (significant && worse > threshold) {
+      verdict = "REGRESSION";
+      regressions++;
+    }
+    else if (significant && worse < -threshold) {
+      verdict = "improved";
+      improvements++;
+    }
+    char pText[16] = "-";
+    if (sampled) snprintf(pText, sizeof(pText), "%.2g", p);
+    printf("%-48s %12.4g %12.4g %+8.1f%% %8s  %s %s\n", result.name.c_str(), then, now, change * 100, pText, result.unit.c_str(), verdict);
+  }
+  printf("%d regressions, %d improvements, %d unverified (threshold %g %%)\n", regressions, improvements, unverified, threshold * 100);
+  if (unverified) printf("Unverified changes have too few samples to be tested, run with BENCH_REPEAT=5 or more\n");
+  return regressions;
+}
+
+int Benchmark::Compare(const char* baselinePath, const char* currentPath, double threshold) {
+  std::vector<Result> baseline, current;
+  if (!ReadJson(baselinePath, baseline)) {
+    printf("Cannot read %s\n", baselinePath);
+    return -1;
+  }
+  if (!ReadJson(currentPath, current)) {
+    printf("Cannot read %s\n", currentPath);
+    return -1;
+  }
+  return Compare(baseline, current, threshold);
+}
@@ -0,0 +1,53 @@
+#ifndef Benchmark_h_
+#define Benchmark_h_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+// Registry of the benchmarks of a module main, and of their results.
+// The mains register their benchmarks and call Run, the benchmarks Record
+// their measures next to their printf (PerfTest records its samples).
+// Run is driven by the environment:
+//   BENCH_FILTER    run only the benchmarks whose name contains it
+//   BENCH_REPEAT    run them N times, each measure gets N samples, 5 or more
+//                   on both sides for Compare to test a single measure
+//   BENCH_JSON      write the results to this file
+//   BENCH_BASELINE  compare the results with this file, see Compare
+class Benchmark {
+public:
+  struct Result {
+    std::string name;   // benchmark/measure
+    std::string unit;
+    bool lowerIsBetter;
+    std::vector<double> samples;
+  };
+
+  static void Register(const char* name, const std::function<void()>& fn);
+
+  // Run the registered benchmarks in registration order,
+  // return the number of regressions against BENCH_BASELINE
+  static int Run(const char* module);
+
+  // Add a measure of the running benchmark. A name measured several times
+  // in a run gets a #2, #3... suffix, a repeated run adds its samples to
+  // the same result.
+  static void Record(const char* name, double value, const char* unit, bool lowerIsBetter = true);
+  static void Record(const char* name, const std::vector<double>& samples, const char* unit, bool lowerIsBetter = true);
+
+  static const std::vector<Result>& Results();
+
+  static bool WriteJson(const char* path, const char* module, const std::vector<Result>& results);
+  static bool ReadJson(const char* path, std::vector<Result>& results);
+
+  // Print the changes of current against baseline and return the number of
+  // regressions: the median got worse by more than threshold, and a
+  // Mann-Whitney U test gives p < 0.01. The test needs 5 samples on each
+  // side to reach it: changes of fewer samples are reported as unverified,
+  // they are not counted.
+  static int Compare(const std::vector<Result>& baseline, const std::vector<Result>& current, double threshold = 0.05);
+  static int Compare(const char* baselinePath, const char* currentPath, double threshold = 0.05);
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "chrono.h"
+#include "benchmark.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CHRONO_HAS_TSC 1
+#else
+#define CHRONO_HAS_TSC 0
+#endif
+
+// NOTE on the TSC clock:
+//
+// With an invariant TSC (cpuid 0x80000007 EDX bit 8) the counter ticks at
+// a constant rate on all the cores, whatever the frequency scaling, so it
+// is a clock of ~20 cycles per read, without a system call. rdtscp waits
+// for the previous instructions to complete before reading it. Its rate
+// is not reported by the cpu, it is measured against the OS clock.
+
+static uint64_t MonotonicNS() {
+#if defined(_WIN32)
+  static int64_t freq = 0;
+  int64_t t;
+  if (!freq) QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+  QueryPerformanceCounter((LARGE_INTEGER*)&t);
+  return uint64_t(double(t) * 1e9 / double(freq));
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return uint64_t(t.tv_sec) * 1000000000ull + uint64_t(t.tv_nsec);
+#endif
+}
+
+#if CHRONO_HAS_TSC
+static inline uint64_t ReadTsc() {
+  unsigned int aux;
+  return __rdtscp(&aux);
+}
+
+static bool HasInvariantTsc() {
+  unsigned int regs[4] = { 0 };
+#if defined(_WIN32)
+  __cpuid((int*)regs, 0x80000000);
+  if (regs[0] < 0x80000007) return false;
+  __cpuid((int*)regs, 0x80000001);
+  bool rdtscp = (regs[3] & (1 << 27)) != 0;
+  __cpuid((int*)regs, 0x80000007);
+#else
+  if (__get_cpuid_max(0x80000000, 0) < 0x80000007) return false;
+  __get_cpuid(0x80000001, &regs[0], &regs[1], &regs[2], &regs[3]);
+  bool rdtscp = (regs[3] & (1 << 27)) != 0;
+  __get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+  return rdtscp && (regs[3] & (1 << 8)) != 0;
+}
+#endif
+
+struct ChronoClock {
+  bool tsc;
+  uint64_t freq;   // Ticks per second
+
+  ChronoClock() : tsc(false), freq(1000000000ull) {
+#if CHRONO_HAS_TSC
+    if (HasInvariantTsc()) {
+      this->tsc = true;
+      this->freq = Calibrate();
+    }
+#endif
+  }
+
+#if CHRONO_HAS_TSC
+  // Count the ticks over 20 ms of OS clock, each OS clock read is
+  // bracketed by two TSC reads to bound the error of the pairing
+  static uint64_t Calibrate() {
+    uint64_t tsc0 = ReadTsc();
+    uint64_t ns0 = MonotonicNS();
+    uint64_t tsc1 = ReadTsc();
+    uint64_t start = (tsc0 + tsc1) / 2;
+    uint64_t ns;
+    do {
+      tsc0 = ReadTsc();
+      ns = MonotonicNS();
+      tsc1 = ReadTsc();
+    } while (ns - ns0 < 20000000ull);
+    uint64_t end = (tsc0 + tsc1) / 2;
+    return uint64_t(double(end - start) * 1e9 / double(ns - ns0));
+  }
+#endif
+};
+
+static const ChronoClock& Clock() {
+  static ChronoClock clock;
+  return clock;
+}
+
+uint64_t Chrono::Now() {
+#if CHRONO_HAS_TSC
+  if (Clock().tsc) return ReadTsc();
+#endif
+  return MonotonicNS();
+}
+
+bool Chrono::IsTscClock() {
+  return Clock().tsc;
+}
+
+Chrono::Chrono() {
+  this->Start();
+}
+
+void Chrono::Start() {
+  t0 = Now();
+}
+
+double Chrono::GetDiffDouble(PRECISION unit) {
+  uint64_t t1 = Now() - t0;
+  return double(t1) * double(unit) / double(Clock().freq);
+}
+
+float Chrono::GetDiffFloat(PRECISION unit) {
+  return (float)this->GetDiffDouble(unit);
+}
+
+float Chrono::GetOpsFloat(uint64_t ncycle, OPS unit) {
+  return float(double(ncycle)/this->GetDiffDouble(S))/float(unit);
+}
+
+uint64_t Chrono::GetNumCycleClock() {
+  return Now() - t0;
+}
+
+uint64_t Chrono::GetFreq() {
+  return Clock().freq;
+}
+
+static bool hardware_counters = true;
+
+bool Chrono::SetHardwareCounters(bool enabled) {
+  bool previous = hardware_counters;
+  hardware_counters = enabled;
+  return previous;
+}
+
+#define PERFTIME_ONE_CYCLE 0
+Chrono::Stats Chrono::PerfTest(const char* title, const std::function<void()>& cb) {
+  const double kWarmupNS = 50e6;
+  const double kSampleNS = 20e3;   // Batch duration, ~1000x the clock read
+  const double kMaxNS = 1e9;
+  const int kMinSamples = 5;
+  const int kMaxSamples = 1000;
+
+  double nsPerTick = 1e9 / double(Clock().freq);
+  std::vector<double> times;
+  Stats stats;
+  PerfCounters counters;
+  bool counted = hardware_counters && counters.IsAvailable();
+#if PERFTIME_ONE_CYCLE
+  if (counted) counters.Start();
+  uint64_t t = Now();
+  cb();
+  times.push_back(double(Now() - t) * nsPerTick);
+  if (counted) counters.Stop();
+  stats.batch = 1;
+#else
+  // Warm-up: caches, branch predictors and cpu frequency settle,
+  // and gives the cost of a call to size the batches
+  uint64_t calls = 0;
+  uint64_t start = Now();
+  double elapsed;
+  do {
+    cb();
+    calls++;
+    elapsed = double(Now() - start) * nsPerTick;
+  } while (elapsed < kWarmupNS);
+  double callNS = elapsed / double(calls);
+  stats.batch = callNS >= kSampleNS ? 1 : uint64_t(kSampleNS / callNS) + 1;
+
+  // The counters run over all the batches: reading them per batch would
+  // cost a system call in each measure
+  if (counted) counters.Start();
+  start = Now();
+  do {
+    uint64_t t = Now();
+    for (uint64_t i = 0; i < stats.batch; i++) {
+      cb();
+    }
+    uint64_t end = Now();
+    times.push_back(double(end - t) * nsPerTick / double(stats.batch));
+    elapsed = double(end - start) * nsPerTick;
+  } while (int(times.size()) < kMinSamples || (elapsed < kMaxNS && int(times.size()) < kMaxSamples));
+  if (counted) counters.Stop();
+#endif
+
+  std::sort(times.begin(), times.end());
+  size_t n = times.size();
+  double sum = 0, sum2 = 0;
+  for (size_t i = 0; i < n; i++) sum += times[i];
+  stats.mean = sum / double(n);
+  for (size_t i = 0; i < n; i++) sum2 += (times[i] - stats.mean) * (times[i] - stats.mean);
+  stats.samples = int(n);
+  stats.min = times[0];
+  stats.median = times[n / 2];
+  stats.p99 = times[std::min(n - 1, size_t(ceil(double(n) * 0.99)) - 1)];
+  stats.stddev = n > 1 ? sqrt(sum2 / double(n - 1)) : 0;
+  stats.mops = stats.median > 0 ? 1e3 / stats.median : 0;
+
+  printf("%s : %.3g Mops (ns/op min %.3g median %.3g p99 %.3g stddev %.3g, %d x %llu calls)\n",
+    title, stats.mops, stats.min, stats.median, stats.p99, stats.stddev,
+    stats.samples, (unsigned long long)stats.batch);
+  Benchmark::Record(title, times, "ns/op");
+
+  stats.counters = counters.Read();
+  stats.ipc = 0;
+  if (counted) {
+    double calls = double(n) * double(stats.batch);
+    for (int i = 0; i < PerfCounters::COUNT; i++) {
+      stats.perCall[i] = stats.counters.valid[i] ? double(stats.counters.counts[i]) / calls : 0;
+    }
+    if (stats.counters.valid[PerfCounters::CYCLES] && stats.counters.valid[PerfCounters::INSTRUCTIONS] && stats.perCall[PerfCounters::CYCLES] > 0) {
+      stats.ipc = stats.perCall[PerfCounters::INSTRUCTIONS] / stats.perCall[PerfCounters::CYCLES];
+      printf("  IPC %.2f,", stats.ipc);
+    }
+    printf("  per op:");
+    for (int i = 0; i < PerfCounters::COUNT; i++) {
+      if (stats.counters.valid[i]) printf(" %s %.3g", PerfCounters::Name(PerfCounters::COUNTER(i)), stats.perCall[i]);
+      else printf(" %s n/a", PerfCounters::Name(PerfCounters::COUNTER(i)));
+    }
+    printf("\n");
+  }
+  else {
+    for (int i = 0; i < PerfCounters::COUNT; i++) stats.perCall[i] = 0;
+  }
+  return stats;
+}
@@ -0,0 +1,69 @@
+#ifndef Chrono_h_
+#define Chrono_h_
+#pragma pack(push)
+#pragma pack()
+
+#include <stdint.h>
+#include <functional>
+#include "perfcounters.h"
+
+// Shared timer of the playground benchmarks.
+// On x86 with an invariant TSC the clock is rdtscp, calibrated once against
+// the OS monotonic clock (CLOCK_MONOTONIC or QueryPerformanceCounter),
+// else the OS monotonic clock itself.
+class Chrono {
+  uint64_t t0;
+public:
+
+  enum PRECISION {
+    S=1,
+    MS=1000,
+    US=1000000,
+    NS=1000000000,
+  };
+
+  enum OPS {
+    ops=1,
+    Kops=1000,
+    Mops=1000000,
+  };
+
+  // PerfTest result, times are per call in ns
+  struct Stats {
+    int samples;      // Timed batches
+    uint64_t batch;   // Calls per batch
+    double min;
+    double median;
+    double p99;
+    double mean;
+    double stddev;
+    double mops;      // From the median
+
+    // Hardware counters per call over the timed batches, when valid
+    PerfCounters::Values counters;
+    double perCall[PerfCounters::COUNT];
+    double ipc;
+  };
+
+  Chrono();
+  void Start();
+  double GetDiffDouble(PRECISION unit = S);
+  float GetDiffFloat(PRECISION unit = S);
+  float GetOpsFloat(uint64_t ncycle, OPS unit = ops);
+  uint64_t GetNumCycleClock();   // Clock ticks since Start
+  uint64_t GetFreq();            // Clock ticks per second
+
+  // Warm up cb, then time batches of calls long enough to hide the clock
+  // overhead, and print the distribution of the time per call, with the
+  // hardware counters per call when enabled and available
+  Stats PerfTest(const char* title, const std::function<void()>& cb);
+
+  // Return the previous setting, enabled by default
+  static bool SetHardwareCounters(bool enabled);
+
+  static uint64_t Now();   // Raw clock ticks
+  static bool IsTscClock();
+};
+
+#pragma pack(pop)
+#endif
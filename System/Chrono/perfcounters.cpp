@@ -0,0 +1,117 @@
+#include "perfcounters.h"
+#include <string.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int OpenCounter(uint32_t type, uint64_t config, int group) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = group < 0;   // The group starts with its leader
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static uint64_t CacheMiss(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+PerfCounters::PerfCounters() : leader(-1) {
+  static const struct {
+    uint32_t type;
+    uint64_t config;
+  } events[COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_DTLB) },
+  };
+  for (int i = 0; i < COUNT; i++) {
+    fds[i] = OpenCounter(events[i].type, events[i].config, leader);
+    if (leader < 0) leader = fds[i];
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int i = 0; i < COUNT; i++) {
+    if (fds[i] >= 0) close(fds[i]);
+  }
+}
+
+void PerfCounters::Start() {
+  if (leader < 0) return;
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::Stop() {
+  if (leader < 0) return;
+  ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::Values PerfCounters::Read() {
+  Values values;
+  memset(&values, 0, sizeof(values));
+  if (leader < 0) return values;
+
+  // Group layout: nr, time_enabled, time_running, { value, id } x nr
+  uint64_t buffer[3 + 2 * COUNT];
+  if (read(leader, buffer, sizeof(buffer)) < 24) return values;
+  uint64_t nr = buffer[0];
+  uint64_t enabled = buffer[1];
+  uint64_t running = buffer[2];
+  if (running == 0) return values;   // The group never got the PMU
+  double scale = double(enabled) / double(running);
+
+  // The values follow the opening order, skipping the counters not opened
+  uint64_t n = 0;
+  for (int i = 0; i < COUNT && n < nr; i++) {
+    if (fds[i] < 0) continue;
+    values.counts[i] = uint64_t(double(buffer[3 + 2 * n]) * scale);
+    values.valid[i] = true;
+    n++;
+  }
+  return values;
+}
+
+#else
+
+PerfCounters::PerfCounters() : leader(-1) {
+  for (int i = 0; i < COUNT; i++) fds[i] = -1;
+}
+
+PerfCounters::~PerfCounters() {
+}
+
+void PerfCounters::Start() {
+}
+
+void PerfCounters::Stop() {
+}
+
+PerfCounters::Values PerfCounters::Read() {
+  Values values;
+  memset(&values, 0, sizeof(values));
+  return values;
+}
+
+#endif
+
+bool PerfCounters::IsAvailable() {
+  return leader >= 0;
+}
+
+const char* PerfCounters::Name(COUNTER counter) {
+  static const char* names[COUNT] = { "cycles", "instructions", "L1D miss", "LLC miss", "branch miss", "dTLB miss" };
+  return names[counter];
+}
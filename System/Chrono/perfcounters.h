@@ -0,0 +1,46 @@
+#ifndef PerfCounters_h_
+#define PerfCounters_h_
+
+#include <stdint.h>
+
+// Hardware performance counters of the calling thread, read as one
+// perf_event_open group on Linux (user space only). A counter the kernel
+// or the PMU refuses is reported as unavailable, and when none opens
+// (containers, perf_event_paranoid, other OS) all of them are, the
+// measures then run without counters.
+class PerfCounters {
+public:
+  enum COUNTER {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    DTLB_MISSES,
+    COUNT,
+  };
+
+  struct Values {
+    uint64_t counts[COUNT];
+    bool valid[COUNT];
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+
+  bool IsAvailable();
+  static const char* Name(COUNTER counter);
+
+  // Reset and count until Stop
+  void Start();
+  void Stop();
+
+  // Counts since Start, scaled when the group was multiplexed with others
+  Values Read();
+
+private:
+  int fds[COUNT];
+  int leader;
+};
+
+#endif
@@ -1,7 +1,8 @@
 #include <vector>
 #include <string>
 #include <fstream>
-#include "./chrono.h"
+#include "chrono.h"
+#include "benchmark.h"
 #include "./PersistentState.h"
 
 typedef std::string IDEName;
@@ -62,6 +63,7 @@ struct PointList : Persistent {
 void test_perf() {
    Chrono c;
    int count = 1000000;
+   double seconds;
 
    c.Start();
    for (int i = 0; i < count; i++) {
@@ -69,7 +71,9 @@ void test_perf() {
       auto x = new BufTest();
       delete x;
    }
-   printf("> Time persistant alloc: %g s\n", c.GetDiffFloat(Chrono::S));
+   seconds = c.GetDiffDouble(Chrono::S);
+   printf("> Time persistant alloc: %g s\n", seconds);
+   Benchmark::Record("persistant alloc", seconds, "s");
 
    c.Start();
    for (int i = 0; i < count; i++) {
@@ -77,7 +81,9 @@ void test_perf() {
       auto x = new BufTest();
       delete x;
    }
-   printf("> Time malloc: %g s\n", c.GetDiffFloat(Chrono::S));
+   seconds = c.GetDiffDouble(Chrono::S);
+   printf("> Time malloc: %g s\n", seconds);
+   Benchmark::Record("malloc", seconds, "s");
 }
 
 void test_persistance() {
@@ -135,7 +141,8 @@ void main() {
    wFS::OpenHeap(TEST_STATE_PATH);
    wFS::ResetHeap();
 
-   test_perf();
+   Benchmark::Register("test_perf", test_perf);
+   Benchmark::Run("PersistentState");
    test_persistance();
    test_map();
 }
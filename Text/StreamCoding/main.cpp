@@ -5,7 +5,8 @@
 #include <sstream>
 #include <codecvt>
 #include <Windows.h>
-#include "./chrono.h"
+#include "chrono.h"
+#include "benchmark.h"
 
 
 using namespace streamwriter;
@@ -57,8 +58,11 @@ IStringOutStream* NewConsoleOutputStream() {
 
 extern"C" IStringOutStream * stream = NewConsoleOutputStream();
 
+static char test_name[128];
+
 void reportTime(double time_ms, int size) {
    printf("  %d bytes - %lg ms\n", size, time_ms);
+   Benchmark::Record(test_name, time_ms, "ms");
 }
 
 void write_polymorph(writer& output, IEncoding* outputEncoding, reader input, IEncoding* inputEncoding) {
@@ -72,7 +76,8 @@ void write_polymorph(writer& output, IEncoding* outputEncoding, reader input, IE
 
 template <class Tin, class Tout>
 void test_static(std::vector<char>& chars) {
-   printf("\n> static - %s -> %s\n", Tin::name(), Tout::name());
+   snprintf(test_name, sizeof(test_name), "static - %s -> %s", Tin::name(), Tout::name());
+   printf("\n> %s\n", test_name);
    stream_utf8 out(stream->Reset());
    Chrono chrono;
    out.put<Tin, Tout>(&chars[0], chars.size());
@@ -81,7 +86,8 @@ void test_static(std::vector<char>& chars) {
 }
 
 void test_dynamic_by_fragment(std::vector<char>& chars, IEncoding* inputEncoding, IEncoding* outputEncoding) {
-   printf("\n> dynamic.charBatch - %s -> %s\n", inputEncoding->getName(), outputEncoding->getName());
+   snprintf(test_name, sizeof(test_name), "dynamic.charBatch - %s -> %s", inputEncoding->getName(), outputEncoding->getName());
+   printf("\n> %s\n", test_name);
    writer out(stream->Reset());
    Chrono chrono;
    write_polymorph(out, outputEncoding, reader(&chars[0], chars.size()), inputEncoding);
@@ -90,7 +96,8 @@ void test_dynamic_by_fragment(std::vector<char>& chars, IEncoding* inputEncoding
 }
 
 void test_dynamic_char_by_char(std::vector<char>& chars, IEncoding* inputEncoding, IEncoding* outputEncoding) {
-   printf("\n> dynamic.charByChar - %s -> %s\n", inputEncoding->getName(), outputEncoding->getName());
+   snprintf(test_name, sizeof(test_name), "dynamic.charByChar - %s -> %s", inputEncoding->getName(), outputEncoding->getName());
+   printf("\n> %s\n", test_name);
    writer out(stream->Reset());
    reader in(&chars[0], chars.size());
    Chrono chrono;
@@ -102,7 +109,8 @@ void test_dynamic_char_by_char(std::vector<char>& chars, IEncoding* inputEncodin
 }
 
 void test_std_codecvt_utf8(std::vector<char>& chars) {
-   printf("\n> std::codecvt_utf8\n");
+   snprintf(test_name, sizeof(test_name), "std::codecvt_utf8");
+   printf("\n> %s\n", test_name);
    std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_conv;
    std::wstring in((wchar_t*)&chars[0], chars.size() / 2);
    Chrono chrono;
@@ -112,7 +120,8 @@ void test_std_codecvt_utf8(std::vector<char>& chars) {
 
 
 void test_win32_MultiByteToWideChar(std::vector<char>& chars, int codepage, const char* codepage_name) {
-   printf("\n> win32 MultiByte To WChar - %s\n", codepage_name);
+   snprintf(test_name, sizeof(test_name), "win32 MultiByte To WChar - %s", codepage_name);
+   printf("\n> %s\n", test_name);
    std::wstring out(chars.size(), 0);
    Chrono chrono;
    int out_size;
@@ -122,7 +131,8 @@ void test_win32_MultiByteToWideChar(std::vector<char>& chars, int codepage, cons
 }
 
 void test_win32_WideCharToMultiByte(std::vector<char>& chars, int codepage, const char* codepage_name) {
-   printf("\n> win32 WChar To MultiByte - %s\n", codepage_name);
+   snprintf(test_name, sizeof(test_name), "win32 WChar To MultiByte - %s", codepage_name);
+   printf("\n> %s\n", test_name);
    std::string out(chars.size()*2, 0);
    Chrono chrono;
    int out_size;
@@ -132,7 +142,8 @@ void test_win32_WideCharToMultiByte(std::vector<char>& chars, int codepage, cons
 }
 
 void test_fast_copy(std::vector<char>& chars) {
-   printf("\n> fast copy\n");
+   snprintf(test_name, sizeof(test_name), "fast copy");
+   printf("\n> %s\n", test_name);
    int length = chars.size();
    char* out = new char[length];
    Chrono chrono;
@@ -148,28 +159,39 @@ void main() {
    std::vector<char> chars;
    for (int i = 0; i < 10000000; i++) chars.push_back(rand());
 
-   printf("\n\n-------------- copy --------------\n");
-   test_static<coding::ascii, coding::ascii>(chars);
-   test_static<coding::utf8, coding::utf8>(chars);
-   test_static<coding::acp, coding::acp>(chars);
-
-   printf("\n\n-------------- static convert --------------\n");
-   test_static<coding::acp, coding::utf8>(chars);
-   test_static<coding::utf8, coding::acp>(chars);
-
-   printf("\n\n-------------- dynamic convert --------------\n");
-   test_dynamic_by_fragment(chars, inputEncoding, outputEncoding);
-   test_dynamic_char_by_char(chars, inputEncoding, outputEncoding);
-   test_dynamic_by_fragment(chars, outputEncoding, inputEncoding);
-   test_dynamic_char_by_char(chars, outputEncoding, inputEncoding);
-
-   printf("\n\n-------------- win32 convert --------------\n");
-   test_win32_MultiByteToWideChar(chars, CP_UTF8, "UTF8");
-   test_win32_WideCharToMultiByte(chars, CP_UTF8, "UTF8");
-   test_win32_MultiByteToWideChar(chars, CP_ACP, "ACP");
-   test_win32_WideCharToMultiByte(chars, CP_ACP, "ACP");
-
-   printf("\n\n-------------- other --------------\n");
-   test_std_codecvt_utf8(chars);
-   test_fast_copy(chars);
+   Benchmark::Register("copy", [&chars]() {
+      printf("\n\n-------------- copy --------------\n");
+      test_static<coding::ascii, coding::ascii>(chars);
+      test_static<coding::utf8, coding::utf8>(chars);
+      test_static<coding::acp, coding::acp>(chars);
+   });
+
+   Benchmark::Register("static convert", [&chars]() {
+      printf("\n\n-------------- static convert --------------\n");
+      test_static<coding::acp, coding::utf8>(chars);
+      test_static<coding::utf8, coding::acp>(chars);
+   });
+
+   Benchmark::Register("dynamic convert", [&chars]() {
+      printf("\n\n-------------- dynamic convert --------------\n");
+      test_dynamic_by_fragment(chars, inputEncoding, outputEncoding);
+      test_dynamic_char_by_char(chars, inputEncoding, outputEncoding);
+      test_dynamic_by_fragment(chars, outputEncoding, inputEncoding);
+      test_dynamic_char_by_char(chars, outputEncoding, inputEncoding);
+   });
+
+   Benchmark::Register("win32 convert", [&chars]() {
+      printf("\n\n-------------- win32 convert --------------\n");
+      test_win32_MultiByteToWideChar(chars, CP_UTF8, "UTF8");
+      test_win32_WideCharToMultiByte(chars, CP_UTF8, "UTF8");
+      test_win32_MultiByteToWideChar(chars, CP_ACP, "ACP");
+      test_win32_WideCharToMultiByte(chars, CP_ACP, "ACP");
+   });
+
+   Benchmark::Register("other", [&chars]() {
+      printf("\n\n-------------- other --------------\n");
+      test_std_codecvt_utf8(chars);
+      test_fast_copy(chars);
+   });
+   Benchmark::Run("StreamCoding");
 }
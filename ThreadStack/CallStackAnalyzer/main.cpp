@@ -2,7 +2,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <intrin.h>
-#include "./chrono.h"
+#include "chrono.h"
+#include "benchmark.h"
 
 #include <windows.h>
 #include <psapi.h>
@@ -147,6 +148,9 @@ struct tTimes {
     printf("-----------------------------------\n");
     printf("total_time: %lg\n", total_time / double(count));
     printf("-----------------------------------\n");
+    Benchmark::Record("read_register_time", read_register_time / double(count), "us");
+    Benchmark::Record("read_stack_time", read_stack_time / double(count), "us");
+    Benchmark::Record("total_time", total_time / double(count), "us");
   }
 } capture_times;
 
@@ -309,6 +313,7 @@ void calltest(int level) {
 }
 
 void perfStackCapture() {
+  capture_times = tTimes();
   for (int i = 0; i < 1000; i++) {
     calltest(25);
   }
@@ -328,6 +333,7 @@ void perfSamples() {
     }
     double rtime = c.GetDiffDouble(Chrono::US) / double(count);
     printf("malloc_time: %lg\n", rtime);
+    Benchmark::Record("malloc_time", rtime, "us");
   }
   {
     c.Start();
@@ -336,6 +342,7 @@ void perfSamples() {
     }
     double rtime = c.GetDiffDouble(Chrono::US) / double(count);
     printf("multadd_time: %lg\n", rtime);
+    Benchmark::Record("multadd_time", rtime, "us");
   }
   {
      c.Start();
@@ -344,10 +351,12 @@ void perfSamples() {
      }
      double rtime = c.GetDiffDouble(Chrono::US) / double(count);
      printf("add_time: %lg\n", rtime);
+     Benchmark::Record("add_time", rtime, "us");
   }
 }
 
 void main() {
-  perfSamples();
-  perfStackCapture();
+  Benchmark::Register("perfSamples", perfSamples);
+  Benchmark::Register("perfStackCapture", perfStackCapture);
+  Benchmark::Run("CallStackAnalyzer");
 }